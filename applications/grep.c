@@ -1,19 +1,50 @@
 #include <stdio.h>
+#include <string.h>
 #include "lib.h"
 #include "minispark.h"
 
 int main(int argc, char* argv[]) {
-  if (argc < 3) {
+  // -f reads one pattern per line, lines containing any of them are printed,
+  // or only lines containing all of them with -a
+  int all = 0;
+  char* patternfile = NULL;
+  int arg = 1;
+  while (arg < argc && argv[arg][0] == '-') {
+    if (strcmp(argv[arg], "-a") == 0) {
+      all = 1;
+      arg++;
+    } else if (strcmp(argv[arg], "-f") == 0 && arg + 1 < argc) {
+      patternfile = argv[arg + 1];
+      arg += 2;
+    } else {
+      break;
+    }
+  }
+  if (patternfile == NULL && arg < argc)
+    arg++; // the query
+  if (arg >= argc || (all && patternfile == NULL)) {
     printf("usage: ./grep <query> file1 ...\n");
+    printf("       ./grep [-a] -f <patternfile> file1 ...\n");
+    return -1;
+  }
+
+  struct pattern_set* patterns = NULL;
+  if (patternfile != NULL && (patterns = LoadPatterns(patternfile, all)) == NULL) {
+    printf("cannot read patterns from %s\n", patternfile);
     return -1;
   }
 
   MS_Run();
   
-  RDD* files = RDDFromFiles(argv + 2, argc - 2);
-  print(filter(map(files, GetLines), StringContains, argv[1]), StringPrinter);
+  RDD* files = RDDFromFiles(argv + arg, argc - arg);
+  if (patterns != NULL)
+    print(filter(map(files, GetLines), StringMatchesPatterns, patterns), StringPrinter);
+  else
+    print(flatMap(files, GrepLines, argv[arg - 1]), StringPrinter);
 
   MS_TearDown();
 
+  if (patterns != NULL)
+    FreePatterns(patterns);
   return 0;
 }
@@ -10,7 +10,7 @@ int main(int argc, char* argv[]) {
 
   MS_Run();
   RDD* files = RDDFromFiles(argv + 2, argc - 2);
-  int matches = count(filter(map(files, GetLines), StringContains, argv[1]));
+  int matches = count(flatMap(files, GrepLines, argv[1]));
 
   MS_TearDown();
   printf("found %d matches\n", matches);
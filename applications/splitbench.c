@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "lib.h"
+
+#define ROUNDS (100)
+#define REPEATS (5) // the fastest repeat counts, the others caught noise
+
+// SplitCols as it was before FindFields, the baseline to beat
+void* SplitColsStrtok(void* arg) {
+  char *line = (char*)arg;
+
+  struct row* row = malloc(sizeof(struct row));
+  int nc = 0;
+  char* ret;
+  char* delim = " \t\n";
+  char* saveptr;
+
+  ret = strtok_r(line, delim, &saveptr);
+  while (ret != NULL && nc < MAXCOLS) {
+    strncpy(row->cols[nc], ret, MAXLEN);
+    row->cols[nc++][MAXLEN-1] = '\0';
+    ret = strtok_r(NULL, delim, &saveptr);
+  }
+  row->ncols = nc;
+
+  free(line);
+  return (void*)row;
+}
+
+// Splits every line ROUNDS times, copying it first like GetLines hands out fresh lines
+double run(void* (*split)(void*), char** lines, int nlines, long* checksum) {
+  struct timeval start, end;
+  gettimeofday(&start, NULL);
+  for (int r = 0; r < ROUNDS; r++) {
+    for (int i = 0; i < nlines; i++) {
+      struct row* row = split(strdup(lines[i]));
+      *checksum += row->ncols;
+      for (int c = 0; c < row->ncols; c++)
+        *checksum += row->cols[c][0];
+      free(row);
+    }
+  }
+  gettimeofday(&end, NULL);
+  return (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) * 1e-6;
+}
+
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    printf("need at least one file\n");
+    return -1;
+  }
+
+  int nlines = 0;
+  int cap = 1024;
+  char** lines = malloc(sizeof(char*) * cap);
+  for (int i = 1; i < argc; i++) {
+    FILE* fp = fopen(argv[i], "r");
+    if (fp == NULL) {
+      perror(argv[i]);
+      return -1;
+    }
+    char* line = NULL;
+    size_t size = 0;
+    while (getline(&line, &size, fp) != -1) {
+      if (nlines == cap) {
+        cap *= 2;
+        lines = realloc(lines, sizeof(char*) * cap);
+      }
+      lines[nlines++] = strdup(line);
+    }
+    free(line);
+    fclose(fp);
+  }
+
+  // Same columns from both, otherwise the timings compare different work
+  long expected = 0, checksum = 0;
+  double baseline = 0, vectorized = 0;
+  for (int i = 0; i < REPEATS; i++) {
+    double t = run(SplitColsStrtok, lines, nlines, &expected);
+    baseline = i == 0 || t < baseline ? t : baseline;
+    t = run(SplitCols, lines, nlines, &checksum);
+    vectorized = i == 0 || t < vectorized ? t : vectorized;
+  }
+  if (checksum != expected) {
+    printf("SplitCols and strtok_r disagree\n");
+    return 1;
+  }
+
+  printf("%d lines x %d rounds\n", nlines, ROUNDS);
+  printf("strtok_r:  %.6f seconds\n", baseline);
+  printf("SplitCols: %.6f seconds (%.2fx)\n", vectorized, baseline / vectorized);
+
+  for (int i = 0; i < nlines; i++)
+    free(lines[i]);
+  free(lines);
+  return 0;
+}
@@ -23,22 +23,22 @@ int main(int argc, char* argv[]) {
 
   MS_Run();
   if (numfiles == 2) {
-    RDD* data1 = map(map(RDDFromFiles(files, 1), GetLines), SplitCols);
-    RDD* data2 = map(map(RDDFromFiles(files + 1, 1), GetLines), SplitCols);
-    print(join(data1, data2, SumJoin, (void*)&sctx), RowPrinter);
+    RDD* data1 = map(map(RDDFromFiles(files, 1), GetLines), SplitFields);
+    RDD* data2 = map(map(RDDFromFiles(files + 1, 1), GetLines), SplitFields);
+    print(join(data1, data2, FieldSumJoin, (void*)&sctx), RowPrinter);
   } else {
     int group1 = numfiles / 2;
     int group2 = numfiles - group1;
     
-    RDD* data1 = map(map(RDDFromFiles(files, group1), GetLines), SplitCols);
-    RDD* data2 = map(map(RDDFromFiles(files + group1, group2), GetLines), SplitCols);
+    RDD* data1 = map(map(RDDFromFiles(files, group1), GetLines), SplitFields);
+    RDD* data2 = map(map(RDDFromFiles(files + group1, group2), GetLines), SplitFields);
 
     struct colpart_ctx pctx;
     pctx.keynum = 0;
-    RDD* repart1 = partitionBy(data1, ColumnHashPartitioner, 4, &pctx);
-    RDD* repart2 = partitionBy(data2, ColumnHashPartitioner, 4, &pctx);
+    RDD* repart1 = partitionBy(data1, FieldColumnHashPartitioner, 4, &pctx);
+    RDD* repart2 = partitionBy(data2, FieldColumnHashPartitioner, 4, &pctx);
 
-    print(join(repart1, repart2, SumJoin, (void*)&sctx), RowPrinter);
+    print(join(repart1, repart2, FieldSumJoin, (void*)&sctx), RowPrinter);
   }
   MS_TearDown();
 }
@@ -1,11 +1,20 @@
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <assert.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/time.h>
 #include "lib.h"
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SEARCH_SIMD
+#endif
+
 #define SLEEPNSEC 1E7 // 10 ms
 
 float numnops = 0;
@@ -90,21 +99,184 @@ void *SleepSec2(void *arg, void *arg2, void* ctx) {
   return argcpy;
 }
 
+typedef const char* (*SearchKernel)(const char* haystack, size_t len, const char* needle, size_t nlen);
+typedef unsigned long long (*DelimKernel)(const char* text, int n);
+
+static SearchKernel search_kernel;
+static DelimKernel delim_kernel;
+static pthread_once_t search_once = PTHREAD_ONCE_INIT;
+
+#define DELIM_BLOCK (64)
+
+static int is_delim(char c) {
+  return c == ' ' || c == '\t' || c == '\n';
+}
+
+// bits at and past n stand for the bytes behind the text, which count as delimiters
+static unsigned long long delim_past(int n) {
+  return n < DELIM_BLOCK ? ~0ULL << n : 0;
+}
+
+// bit i is set if text[i] is a delimiter, for the first n <= DELIM_BLOCK bytes of a block
+static unsigned long long delim_scalar(const char* text, int n) {
+  unsigned long long mask = delim_past(n);
+  for (int i = 0; i < n; i++)
+    mask |= (unsigned long long)is_delim(text[i]) << i;
+  return mask;
+}
+
+static const char* search_scalar(const char* haystack, size_t len, const char* needle, size_t nlen) {
+  return memmem(haystack, len, needle, nlen);
+}
+
+#ifdef SEARCH_SIMD
+// Compares a block of positions at once against the first and the last byte of the
+// needle, only positions where both match are compared in full. nlen is at least 2
+__attribute__((target("sse2")))
+static const char* search_sse2(const char* haystack, size_t len, const char* needle, size_t nlen) {
+  __m128i first = _mm_set1_epi8(needle[0]);
+  __m128i last = _mm_set1_epi8(needle[nlen - 1]);
+  size_t i = 0;
+  for (; i + nlen - 1 + 16 <= len; i += 16) {
+    __m128i head = _mm_loadu_si128((const __m128i*)(haystack + i));
+    __m128i tail = _mm_loadu_si128((const __m128i*)(haystack + i + nlen - 1));
+    unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(head, first),
+                                                    _mm_cmpeq_epi8(tail, last)));
+    while (mask != 0) {
+      int bit = __builtin_ctz(mask);
+      if (memcmp(haystack + i + bit + 1, needle + 1, nlen - 2) == 0)
+        return haystack + i + bit;
+      mask &= mask - 1;
+    }
+  }
+  return search_scalar(haystack + i, len - i, needle, nlen);
+}
+
+// a partial vector is copied out first, so that no byte behind the text is read
+__attribute__((target("sse2")))
+static unsigned long long delim_sse2(const char* text, int n) {
+  unsigned long long mask = 0;
+  for (int i = 0; i < n; i += 16) {
+    __m128i block;
+    if (i + 16 <= n) {
+      block = _mm_loadu_si128((const __m128i*)(text + i));
+    } else {
+      char part[16] = {0};
+      memcpy(part, text + i, n - i);
+      block = _mm_loadu_si128((const __m128i*)part);
+    }
+    __m128i delim = _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8(' ')),
+                                 _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('\t')),
+                                              _mm_cmpeq_epi8(block, _mm_set1_epi8('\n'))));
+    mask |= (unsigned long long)(unsigned)_mm_movemask_epi8(delim) << i;
+  }
+  return mask | delim_past(n);
+}
+
+__attribute__((target("avx2")))
+static const char* search_avx2(const char* haystack, size_t len, const char* needle, size_t nlen) {
+  __m256i first = _mm256_set1_epi8(needle[0]);
+  __m256i last = _mm256_set1_epi8(needle[nlen - 1]);
+  size_t i = 0;
+  for (; i + nlen - 1 + 32 <= len; i += 32) {
+    __m256i head = _mm256_loadu_si256((const __m256i*)(haystack + i));
+    __m256i tail = _mm256_loadu_si256((const __m256i*)(haystack + i + nlen - 1));
+    unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(head, first),
+                                                          _mm256_cmpeq_epi8(tail, last)));
+    while (mask != 0) {
+      int bit = __builtin_ctz(mask);
+      if (memcmp(haystack + i + bit + 1, needle + 1, nlen - 2) == 0)
+        return haystack + i + bit;
+      mask &= mask - 1;
+    }
+  }
+  return search_sse2(haystack + i, len - i, needle, nlen);
+}
+
+__attribute__((target("avx2")))
+static unsigned long long delim_avx2(const char* text, int n) {
+  unsigned long long mask = 0;
+  for (int i = 0; i < n; i += 32) {
+    __m256i block;
+    if (i + 32 <= n) {
+      block = _mm256_loadu_si256((const __m256i*)(text + i));
+    } else {
+      char part[32] = {0};
+      memcpy(part, text + i, n - i);
+      block = _mm256_loadu_si256((const __m256i*)part);
+    }
+    __m256i delim = _mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8(' ')),
+                                    _mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8('\t')),
+                                                    _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\n'))));
+    mask |= (unsigned long long)(unsigned)_mm256_movemask_epi8(delim) << i;
+  }
+  return mask | delim_past(n);
+}
+#endif
+
+// picks the widest kernel the CPU supports
+static void search_init() {
+  search_kernel = search_scalar;
+  delim_kernel = delim_scalar;
+#ifdef SEARCH_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    search_kernel = search_avx2;
+    delim_kernel = delim_avx2;
+  } else if (__builtin_cpu_supports("sse2")) {
+    search_kernel = search_sse2;
+    delim_kernel = delim_sse2;
+  }
+#endif
+}
+
+// A field starts at a non delimiter following a delimiter and ends at a delimiter
+// following a non delimiter. Both are found for a whole block with shifts of its
+// delimiter mask, the carry is the last bit of the previous block
+int FindFields(const char* text, size_t len, int* starts, int* lens, int maxfields) {
+  pthread_once(&search_once, search_init);
+  int nfields = 0;
+  unsigned long long carry = 1; // text is preceded by a delimiter
+  for (size_t i = 0; i < len; i += DELIM_BLOCK) {
+    // bytes past the end count as delimiters, which ends the last field
+    int n = len - i < DELIM_BLOCK ? len - i : DELIM_BLOCK;
+    unsigned long long delim = delim_kernel(text + i, n);
+    unsigned long long prev = (delim << 1) | carry;
+    unsigned long long begins = ~delim & prev;
+    unsigned long long ends = delim & ~prev;
+    carry = delim >> (DELIM_BLOCK - 1);
+
+    // fields are closed and opened in the order of their positions
+    while (begins != 0 || ends != 0) {
+      int begin = begins != 0 ? __builtin_ctzll(begins) : DELIM_BLOCK;
+      int end = ends != 0 ? __builtin_ctzll(ends) : DELIM_BLOCK;
+      if (end < begin) {
+        lens[nfields - 1] = i + end - starts[nfields - 1];
+        ends &= ends - 1;
+        continue;
+      }
+      if (nfields == maxfields)
+        return nfields;
+      starts[nfields++] = i + begin;
+      begins &= begins - 1;
+    }
+  }
+  if (len % DELIM_BLOCK == 0 && carry == 0)
+    lens[nfields - 1] = len - starts[nfields - 1]; // ends at the end of the last full block
+  return nfields;
+}
+
 // accepts a line of text as an argument, returns an array of columns
 void* SplitCols(void* arg) {
   char *line = (char*)arg;
 
   struct row* row = malloc(sizeof(struct row));
-  int nc = 0;
-  char* ret;
-  char* delim = " \t\n";
-  char* saveptr;
-  
-  ret = strtok_r(line, delim, &saveptr);
-  while (ret != NULL) {
-    strncpy(row->cols[nc], ret, MAXLEN);
-    row->cols[nc++][MAXLEN-1] = '\0';
-    ret = strtok_r(NULL, delim, &saveptr);
+  int starts[MAXCOLS], lens[MAXCOLS];
+  int nc = FindFields(line, strlen(line), starts, lens, MAXCOLS);
+  for (int i = 0; i < nc; i++) {
+    int len = lens[i] < MAXLEN - 1 ? lens[i] : MAXLEN - 1;
+    memcpy(row->cols[i], line + starts[i], len);
+    row->cols[i][len] = '\0';
   }
   row->ncols = nc;
   
@@ -112,14 +284,290 @@ void* SplitCols(void* arg) {
   return (void*)row;
 }
 
+// the line is copied once behind the offsets and every field is terminated in place
+void* SplitFields(void* arg) {
+  char *line = (char*)arg;
+  size_t len = strlen(line);
+
+  struct field_row* row = malloc(sizeof(struct field_row) + len + 1);
+  memcpy(row->line, line, len + 1);
+  int lens[MAXCOLS];
+  row->ncols = FindFields(row->line, len, row->cols, lens, MAXCOLS);
+  for (int i = 0; i < row->ncols; i++)
+    row->line[row->cols[i] + lens[i]] = '\0';
+  // missing columns point at the terminating NUL, so they read as ""
+  for (int i = row->ncols; i < MAXCOLS; i++)
+    row->cols[i] = len;
+
+  free(line);
+  return (void*)row;
+}
+
+const char* StringSearch(const char* haystack, size_t len, const char* needle, size_t nlen) {
+  if (nlen == 0)
+    return haystack;
+  if (nlen > len)
+    return NULL;
+  if (nlen == 1)
+    return memchr(haystack, needle[0], len);
+  pthread_once(&search_once, search_init);
+  return search_kernel(haystack, len, needle, nlen);
+}
+
 int StringContains(void* arg, void* needle) {
-  if (strstr((char*)arg, (char*)needle)) {
+  char* str = (char*)arg;
+  if (StringSearch(str, strlen(str), (char*)needle, strlen((char*)needle))) {
     return 1;
   }
   free(arg);
   return 0;
 }
 
+#define PATTERN_ALPHABET (256)
+#define PATTERN_WIDE (16) // children from which a state gets a transition table
+#define PATTERN_SEEN_BYTES (64) // bitmap of seen patterns kept on the stack, for all mode
+
+// Aho-Corasick automaton over all patterns. The root and states with many children have a
+// transition table, every other state keeps a list of its children. A state follows its
+// failure link for any byte it has no child for, so the automaton takes a few ints per
+// pattern byte, and at most PATTERN_ALPHABET / PATTERN_WIDE more for the tables
+struct pattern_set {
+  int all; // 1 if a line must contain every pattern, 0 if any will do
+  int npatterns; // distinct patterns
+  int nstates;
+  int* table; // per state: index of its transition table, -1 if it has none
+  int* tables; // PATTERN_ALPHABET transitions per table, -1 where there is no child
+  int* child; // per state: first child, -1 if none
+  int* sibling; // per state: next child of the same parent, -1 if none
+  unsigned char* label; // per state: byte leading to it from its parent
+  int* fail; // per state: longest proper suffix which is a state too
+  int* pattern; // per state: pattern which ends there, -1 if none
+  int* output; // per state: closest state on its failure chain which ends a pattern, -1 if none
+};
+
+static int pattern_child(struct pattern_set* set, int state, unsigned char c) {
+  if (set->table[state] >= 0)
+    return set->tables[set->table[state] * PATTERN_ALPHABET + c];
+  int s = set->child[state];
+  while (s >= 0 && set->label[s] != c)
+    s = set->sibling[s];
+  return s;
+}
+
+// follows failure links until a state has a transition for c, the root has all of them
+static int pattern_step(struct pattern_set* set, int state, unsigned char c) {
+  int next;
+  while ((next = pattern_child(set, state, c)) < 0)
+    state = set->fail[state];
+  return next;
+}
+
+struct pattern_set* CompilePatterns(char** patterns, int npatterns, int all) {
+  int maxstates = 1;
+  for (int i = 0; i < npatterns; i++)
+    maxstates += strlen(patterns[i]);
+
+  struct pattern_set* set = malloc(sizeof(struct pattern_set));
+  set->all = all;
+  set->npatterns = 0;
+  set->nstates = 1;
+  set->table = malloc(sizeof(int) * maxstates);
+  set->child = malloc(sizeof(int) * maxstates);
+  set->sibling = malloc(sizeof(int) * maxstates);
+  set->label = malloc(maxstates);
+  set->fail = malloc(sizeof(int) * maxstates);
+  set->pattern = malloc(sizeof(int) * maxstates);
+  set->output = malloc(sizeof(int) * maxstates);
+  for (int i = 0; i < maxstates; i++)
+    set->table[i] = set->child[i] = set->pattern[i] = set->output[i] = -1;
+  set->sibling[0] = -1;
+  set->fail[0] = 0;
+
+  // trie of the patterns, a repeated pattern ends in a state which already has one
+  for (int i = 0; i < npatterns; i++) {
+    int state = 0;
+    for (unsigned char* c = (unsigned char*)patterns[i]; *c != '\0'; c++) {
+      int next = pattern_child(set, state, *c);
+      if (next < 0) {
+        next = set->nstates++;
+        set->label[next] = *c;
+        set->sibling[next] = set->child[state];
+        set->child[state] = next;
+      }
+      state = next;
+    }
+    if (set->pattern[state] < 0)
+      set->pattern[state] = set->npatterns++;
+  }
+
+  // tables for the root and the wide states, the root has a transition for every byte
+  int ntables = 0;
+  for (int state = 0; state < set->nstates; state++) {
+    int children = 0;
+    for (int next = set->child[state]; next >= 0; next = set->sibling[next])
+      children++;
+    if (state == 0 || children >= PATTERN_WIDE)
+      set->table[state] = ntables++;
+  }
+  set->tables = malloc(sizeof(int) * ntables * PATTERN_ALPHABET);
+  for (int i = 0; i < ntables * PATTERN_ALPHABET; i++)
+    set->tables[i] = -1;
+  for (int state = 0; state < set->nstates; state++) {
+    if (set->table[state] < 0)
+      continue;
+    int* transitions = &set->tables[set->table[state] * PATTERN_ALPHABET];
+    for (int next = set->child[state]; next >= 0; next = set->sibling[next])
+      transitions[set->label[next]] = next;
+  }
+  for (int c = 0; c < PATTERN_ALPHABET; c++) {
+    if (set->tables[c] < 0)
+      set->tables[c] = 0;
+  }
+
+  // breadth first, so the failure state of every state is complete before its children
+  int* queue = malloc(sizeof(int) * set->nstates);
+  int head = 0, tail = 0;
+  for (int next = set->child[0]; next >= 0; next = set->sibling[next]) {
+    set->fail[next] = 0;
+    queue[tail++] = next;
+  }
+  while (head < tail) {
+    int state = queue[head++];
+    for (int next = set->child[state]; next >= 0; next = set->sibling[next]) {
+      int fallback = pattern_step(set, set->fail[state], set->label[next]);
+      set->fail[next] = fallback;
+      set->output[next] = set->pattern[fallback] >= 0 ? fallback : set->output[fallback];
+      queue[tail++] = next;
+    }
+  }
+  free(queue);
+  return set;
+}
+
+struct pattern_set* LoadPatterns(const char* filename, int all) {
+  FILE* fp = fopen(filename, "r");
+  if (fp == NULL)
+    return NULL;
+  int npatterns = 0;
+  int cap = 16;
+  char** patterns = malloc(sizeof(char*) * cap);
+  char* line;
+  while ((line = GetLines(fp)) != NULL) {
+    line[strcspn(line, "\n")] = '\0';
+    if (npatterns == cap) {
+      cap *= 2;
+      patterns = realloc(patterns, sizeof(char*) * cap);
+    }
+    patterns[npatterns++] = line;
+  }
+  fclose(fp);
+
+  struct pattern_set* set = CompilePatterns(patterns, npatterns, all);
+  for (int i = 0; i < npatterns; i++)
+    free(patterns[i]);
+  free(patterns);
+  return set;
+}
+
+void FreePatterns(struct pattern_set* set) {
+  free(set->table);
+  free(set->tables);
+  free(set->child);
+  free(set->sibling);
+  free(set->label);
+  free(set->fail);
+  free(set->pattern);
+  free(set->output);
+  free(set);
+}
+
+// counts the patterns ending in state which were not seen yet, returns 1 once enough were
+static int pattern_hits(struct pattern_set* set, int state, unsigned char* seen, int* found) {
+  int s = set->pattern[state] >= 0 ? state : set->output[state];
+  for (; s >= 0; s = set->output[s]) {
+    if (!set->all)
+      return 1;
+    int p = set->pattern[s];
+    if (!(seen[p / 8] & (1 << (p % 8)))) {
+      seen[p / 8] |= 1 << (p % 8);
+      if (++*found == set->npatterns)
+        return 1;
+    }
+  }
+  return 0;
+}
+
+int StringMatchesPatterns(void* arg, void* patterns) {
+  struct pattern_set* set = (struct pattern_set*)patterns;
+  char* str = (char*)arg;
+
+  // the set is shared by all tasks, so what was seen is kept here, on the stack unless
+  // there are many patterns
+  unsigned char small[PATTERN_SEEN_BYTES] = {0};
+  unsigned char* seen = small;
+  if (set->all && set->npatterns > PATTERN_SEEN_BYTES * 8)
+    seen = calloc((set->npatterns + 7) / 8, 1);
+  int found = 0;
+  int state = 0;
+  // every string contains all of no patterns, but none contains any of them
+  int matched = set->npatterns == 0 ? set->all : pattern_hits(set, state, seen, &found);
+  for (unsigned char* c = (unsigned char*)str; !matched && *c != '\0'; c++) {
+    state = pattern_step(set, state, *c);
+    matched = pattern_hits(set, state, seen, &found);
+  }
+  if (seen != small)
+    free(seen);
+  if (matched) {
+    return 1;
+  }
+  free(arg);
+  return 0;
+}
+
+void GrepLines(void* arg, void (*emit)(void* out, void* item), void* out, void* needle) {
+  FILE* fp = (FILE*)arg;
+  const char* pattern = (const char*)needle;
+  size_t nlen = strlen(pattern);
+
+  // a line only holds a newline at its end, so no line matches one anywhere else
+  const char* newline = memchr(pattern, '\n', nlen);
+  if (newline != NULL && newline != pattern + nlen - 1)
+    return;
+
+  // pipes and procfs report no size, only regular files are mapped
+  struct stat st;
+  size_t size = 0;
+  char* block = MAP_FAILED;
+  if (fstat(fileno(fp), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    size = st.st_size;
+    block = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+  }
+  if (block == MAP_FAILED) {
+    // not mappable, fall back to reading line by line
+    char* line;
+    while ((line = GetLines(fp)) != NULL) {
+      if (StringContains(line, needle))
+        emit(out, line);
+    }
+    return;
+  }
+
+  // each match yields the line around it, the search resumes after that line
+  size_t pos = 0;
+  while (pos < size) {
+    const char* match = StringSearch(block + pos, size - pos, pattern, nlen);
+    if (match == NULL)
+      break;
+    const char* start = memrchr(block + pos, '\n', match - (block + pos));
+    start = start != NULL ? start + 1 : block + pos;
+    const char* end = memchr(match, '\n', block + size - match);
+    size_t stop = end != NULL ? (size_t)(end - block) + 1 : size;
+    emit(out, strndup(start, block + stop - start));
+    pos = stop;
+  }
+  munmap(block, size);
+}
+
 // for row1 and row2, where each row has been split into columns
 // if the key on column n matches, create a new row with two columns,
 // the key and the sum of column m in the input rows.
@@ -143,13 +591,33 @@ void* SumJoin(void* row1, void* row2, void* ctx) {
 }
 
 
+void* FieldSumJoin(void* row1, void* row2, void* ctx) {
+  struct sumjoin_ctx* c = (struct sumjoin_ctx*)ctx;
+  struct field_row* data1 = (struct field_row*)row1;
+  struct field_row* data2 = (struct field_row*)row2;
+  struct row* row = NULL;
+  char* key = FIELD(data1, c->keynum);
+
+  if (!strcmp(key, FIELD(data2, c->keynum))) {
+    row = malloc(sizeof(struct row));
+    int res = atoi(FIELD(data1, c->target)) + atoi(FIELD(data2, c->target));
+
+    strncpy(row->cols[0], key, MAXLEN);
+    row->cols[0][MAXLEN-1] = '\0';
+    snprintf(row->cols[1], MAXLEN, "%d", res);
+    row->ncols = 2;
+  }
+
+  return (void*)row;
+}
+
 void *SumJoinSleep(void* row1, void* row2, void* ctx) {
   SleepSec();
   return SumJoin(row1, row2, ctx);
 }
 
-// assign row to a partition based on the hash of column n
-unsigned long ColumnHashPartitioner(void* arg, int numpartitions, void* ctx) {
+// hash of column n
+unsigned long RowKeyHash(void* arg, void* ctx) {
   struct colpart_ctx* c = (struct colpart_ctx*)ctx;
   
   unsigned long hash = 5381;
@@ -159,7 +627,38 @@ unsigned long ColumnHashPartitioner(void* arg, int numpartitions, void* ctx) {
   while ((ch = *key++) != '\0')
     hash = hash * 33 + ch;
   
-  return hash % numpartitions;
+  return hash;
+}
+
+int RowKeyEquals(void* row1, void* row2, void* ctx) {
+  struct colpart_ctx* c = (struct colpart_ctx*)ctx;
+  return !strcmp(((struct row*)row1)->cols[c->keynum], ((struct row*)row2)->cols[c->keynum]);
+}
+
+// assign row to a partition based on the hash of column n
+unsigned long ColumnHashPartitioner(void* arg, int numpartitions, void* ctx) {
+  return RowKeyHash(arg, ctx) % numpartitions;
+}
+
+unsigned long FieldRowKeyHash(void* arg, void* ctx) {
+  struct colpart_ctx* c = (struct colpart_ctx*)ctx;
+
+  unsigned long hash = 5381;
+  char ch;
+  char* key = FIELD((struct field_row*)arg, c->keynum);
+  while ((ch = *key++) != '\0')
+    hash = hash * 33 + ch;
+
+  return hash;
+}
+
+int FieldRowKeyEquals(void* row1, void* row2, void* ctx) {
+  struct colpart_ctx* c = (struct colpart_ctx*)ctx;
+  return !strcmp(FIELD((struct field_row*)row1, c->keynum), FIELD((struct field_row*)row2, c->keynum));
+}
+
+unsigned long FieldColumnHashPartitioner(void* arg, int numpartitions, void* ctx) {
+  return FieldRowKeyHash(arg, ctx) % numpartitions;
 }
 
 // assign string to a partition based on its hash
@@ -190,3 +689,60 @@ void RowPrinter(void* arg) {
   }
   printf("\n");
 }
+
+// strings are written as their length followed by the characters
+size_t StringSerialize(void* arg, FILE* fp) {
+  char* str = (char*)arg;
+  unsigned int len = strlen(str);
+  if (fwrite(&len, sizeof(len), 1, fp) != 1 || fwrite(str, 1, len, fp) != len)
+    return 0;
+  return sizeof(len) + len;
+}
+
+void* StringDeserialize(FILE* fp) {
+  unsigned int len;
+  if (fread(&len, sizeof(len), 1, fp) != 1)
+    return NULL;
+
+  char* str = malloc(len + 1);
+  if (fread(str, 1, len, fp) != len) {
+    free(str);
+    return NULL;
+  }
+  str[len] = '\0';
+  return str;
+}
+
+// rows are written as the number of columns followed by each column as a string
+size_t RowSerialize(void* arg, FILE* fp) {
+  struct row* row = (struct row*)arg;
+  if (fwrite(&row->ncols, sizeof(row->ncols), 1, fp) != 1)
+    return 0;
+
+  size_t total = sizeof(row->ncols);
+  for (int i = 0; i < row->ncols; i++) {
+    size_t written = StringSerialize(row->cols[i], fp);
+    if (written == 0)
+      return 0;
+    total += written;
+  }
+  return total;
+}
+
+void* RowDeserialize(FILE* fp) {
+  struct row* row = malloc(sizeof(struct row));
+  if (fread(&row->ncols, sizeof(row->ncols), 1, fp) != 1 || row->ncols < 0 || row->ncols > MAXCOLS) {
+    free(row);
+    return NULL;
+  }
+
+  for (int i = 0; i < row->ncols; i++) {
+    unsigned int len;
+    if (fread(&len, sizeof(len), 1, fp) != 1 || len >= MAXLEN || fread(row->cols[i], 1, len, fp) != len) {
+      free(row);
+      return NULL;
+    }
+    row->cols[i][len] = '\0';
+  }
+  return row;
+}
@@ -1,6 +1,7 @@
 #define MAXCOLS (10)
 #define MAXLEN (32)
 #include <dirent.h>
+#include <stdio.h>
 
 void measureNumNops();
 
@@ -12,6 +13,18 @@ struct row {
   int ncols;
 };
 
+// Row whose columns are offsets into its own copy of the line, where
+// every column is NUL terminated in place. The line is allocated
+// with the row, so one free releases both.
+struct field_row {
+  int ncols;
+  int cols[MAXCOLS];
+  char line[];
+};
+
+// column i of a `struct field_row*`
+#define FIELD(row, i) ((row)->line + (row)->cols[i])
+
 struct sumjoin_ctx {
   int keynum;
   int target;
@@ -26,6 +39,17 @@ struct colpart_ctx {
 // returns: `struct row`
 void* SplitCols(void* arg);
 
+// arg: a char*. Assume whitespace-delimited text.
+// returns: `struct field_row`, columns are not truncated to MAXLEN,
+// columns past ncols are ""
+void* SplitFields(void* arg);
+
+// text: len bytes, need not be NUL terminated
+// returns: number of whitespace-delimited fields, at most maxfields.
+// Field i is the lens[i] bytes at text + starts[i]. Delimiters are
+// found a block at a time with AVX2 or SSE2 when the CPU has them.
+int FindFields(const char* text, size_t len, int* starts, int* lens, int maxfields);
+
 // arg: an opened FILE*
 // returns: a char* or NULL if EOFW
 void* GetLines(void* arg);
@@ -42,24 +66,92 @@ void *SumJoinSleep(void* row1, void* row2, void* ctx);
 // returns: 1 if arg contains needle, or 0.
 int StringContains(void* arg, void* needle);
 
+// haystack: len bytes to search, need not be NUL terminated
+// needle: nlen bytes to find
+// returns: first occurrence of needle in haystack, or NULL.
+// Uses AVX2 or SSE2 when the CPU has them.
+const char* StringSearch(const char* haystack, size_t len, const char* needle, size_t nlen);
+
+// Set of patterns compiled into an Aho-Corasick automaton, which is
+// only read while matching, so one set can be shared by all tasks.
+struct pattern_set;
+
+// patterns: NUL terminated strings
+// all: 1 if a string must contain every pattern, 0 if any will do
+// returns: compiled set, free with FreePatterns
+struct pattern_set* CompilePatterns(char** patterns, int npatterns, int all);
+
+// filename: file with one pattern per line
+// returns: compiled set as CompilePatterns, or NULL if the file can't be read
+struct pattern_set* LoadPatterns(const char* filename, int all);
+
+void FreePatterns(struct pattern_set* set);
+
+// Filter
+// arg: char* string
+// patterns: struct pattern_set*
+// returns: 1 if arg contains any (or all) of the patterns, or 0.
+// An empty set matches nothing with any, and everything with all.
+// All patterns are matched in a single pass over arg.
+int StringMatchesPatterns(void* arg, void* patterns);
+
+// FlatMapper over the files of RDDFromFiles
+// arg: an opened FILE*
+// needle: char* string
+// emits: the lines containing needle, like GetLines followed by
+// StringContains. The file is mapped and searched as a whole, so only
+// matching lines are copied.
+void GrepLines(void* arg, void (*emit)(void* out, void* item), void* out, void* needle);
+
 // Joiners
 // row1, row2: `struct row` to be joined
 // ctx: key (column number) for inner join, and target column to sum
 // returns: new `struct row` containing the key and sum
 void* SumJoin(void* row1, void* row2, void* ctx);
 
+// SumJoin for `struct field_row`, the new row is a `struct row`
+void* FieldSumJoin(void* row1, void* row2, void* ctx);
+
 // Partitioners
 // arg: `struct row`
 // ctx: column number to hash, and number of output partitions
 // returns: output partition
 unsigned long ColumnHashPartitioner(void* arg, int numpartitions, void* ctx);
+unsigned long FieldColumnHashPartitioner(void* arg, int numpartitions, void* ctx);
 
 // arg: char*
 // ctx: number of output partitions
 // returns: output partition
 unsigned long StringHashPartitioner(void* arg, int numpartitions, void* ctx);
 
+// Join keys
+// arg: `struct row`
+// ctx: column number of the key
+// returns: hash of the key column
+unsigned long RowKeyHash(void* arg, void* ctx);
+
+// row1, row2: `struct row`
+// ctx: column number of the key
+// returns: 1 if the key columns are equal, or 0.
+int RowKeyEquals(void* row1, void* row2, void* ctx);
+
+// RowKeyHash and RowKeyEquals for `struct field_row`
+unsigned long FieldRowKeyHash(void* arg, void* ctx);
+int FieldRowKeyEquals(void* row1, void* row2, void* ctx);
+
 // Printers
 // arg: thing to print
 void StringPrinter(void* arg);
 void RowPrinter(void* arg);
+
+// Serializers
+// arg: element to write to fp
+// returns: number of bytes written, or 0 on failure
+size_t StringSerialize(void* arg, FILE* fp);
+size_t RowSerialize(void* arg, FILE* fp);
+
+// Deserializers
+// fp: file positioned at an element written by the matching serializer
+// returns: newly allocated element, or NULL on failure
+void* StringDeserialize(FILE* fp);
+void* RowDeserialize(FILE* fp);
@@ -0,0 +1,534 @@
+#define _GNU_SOURCE
+#include <malloc.h>
+#include "minispark.h"
+
+extern ThreadPool *threadpool;
+
+size_t adaptive_target = 0;
+double skew_factor = 0;
+pthread_mutex_t adaptive_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void MS_SetAdaptivePartitions(size_t bytes)
+{
+  pthread_mutex_lock(&adaptive_lock);
+  adaptive_target = bytes;
+  pthread_mutex_unlock(&adaptive_lock);
+}
+
+void MS_SetSkewJoin(double factor)
+{
+  pthread_mutex_lock(&adaptive_lock);
+  skew_factor = factor;
+  pthread_mutex_unlock(&adaptive_lock);
+}
+
+/* The bucket the partitioner picks out of buckets, which indexes the plan and so must exist */
+int plan_bucket(RDD *rdd, void *data, int buckets)
+{
+  unsigned long bucket = ((Partitioner)rdd->fn)(data, buckets, rdd->ctx);
+  if (bucket >= (unsigned long)buckets)
+  {
+    printf("error: partitioner of RDD %p picked bucket %lu of %d\n", (void *)rdd, bucket, buckets);
+    exit(1);
+  }
+  return bucket;
+}
+
+int partition_of(RDD *rdd, void *data)
+{
+  AdaptivePlan *plan = rdd->plan;
+  if (plan == NULL)
+    return ((Partitioner)rdd->fn)(data, rdd->partitions_cnt, rdd->ctx);
+  return plan->partition[plan_bucket(rdd, data, plan->buckets)];
+}
+
+/* Transformations with one partition per partition of their first dependency */
+bool derived_partitions(RDD *rdd)
+{
+  switch (rdd->trans)
+  {
+    case MAP:
+    case FILTER:
+    case FLATMAP:
+    case MAPPARTITIONS:
+    case SAMPLE:
+    case TOPK:
+    case DISTINCT:
+    case JOIN:
+    case BROADCAST:
+      return true;
+    default:
+      return false;
+  }
+}
+
+int stage_index(RDD **stages, int cnt, RDD *rdd)
+{
+  for (int i = 0; i < cnt; i++)
+  {
+    if (stages[i] == rdd)
+      return i;
+  }
+  return -1;
+}
+
+/* Marks the partitionBy RDDs whose partitions end up in rdd as fixed */
+void fix_partitions(RDD *rdd, RDD **stages, int cnt, bool *fixed)
+{
+  int indx = stage_index(stages, cnt, rdd);
+  if (indx < 0 || fixed[indx])
+    return;
+  fixed[indx] = true;
+  if (rdd->trans == PARTITIONBY)
+    return;
+  if (rdd->trans == UNION || rdd->trans == JOIN)
+  {
+    for (int i = 0; i < rdd->dependencies_cnt; i++)
+      fix_partitions(rdd->dependencies[i], stages, cnt, fixed);
+  }
+  else if (derived_partitions(rdd))
+  {
+    fix_partitions(rdd->dependencies[0], stages, cnt, fixed);
+  }
+}
+
+/* Must be called with queue_mutex held */
+bool stage_scheduled(RDD *rdd)
+{
+  for (int i = 0; i < rdd->partitions_cnt; i++)
+  {
+    if (rdd->scheduled[i])
+      return true;
+  }
+  return false;
+}
+
+/* Replaces the partitions of an RDD nothing was scheduled for. Must be called with
+ * queue_mutex held */
+void resize_partitions(RDD *rdd, int numpartitions)
+{
+  free(rdd->partitions);
+  free(rdd->scheduled);
+  free(rdd->claimed);
+  free(rdd->durations);
+  alloc_partitions(rdd, numpartitions);
+  rdd->materialized_cnt = 0;
+  if (rdd->trans == BROADCAST)
+    rdd->shared_left = numpartitions;
+}
+
+/* Replaces the shuffle files of a partitionBy whose dependency was resized */
+void resize_shuffle(RDD *rdd)
+{
+  if (rdd->shuffle == NULL)
+    return;
+  // shuffle_alloc sized them by the old number of parent partitions, none was written
+  free(rdd->shuffle);
+  rdd->shuffle = shuffle_alloc(rdd->dependencies[0]->partitions_cnt);
+}
+
+/* Adds the bytes the materialized dependency of a partitionBy sends to each of buckets
+ * buckets to sizes */
+void measure_buckets(RDD *rdd, int buckets, size_t *sizes)
+{
+  // Sized the same way blocks are charged
+  RDD *dep = rdd->dependencies[0];
+  for (int i = 0; i < dep->partitions_cnt; i++)
+  {
+    List *partition = dep->partitions[i];
+    list_pin(partition);
+    ListIter iter = list_get_iter(partition);
+    void *data;
+    while ((data = iter_next(&iter)) != NULL)
+    {
+      sizes[plan_bucket(rdd, data, buckets)] += sizeof(ListNode) + malloc_usable_size(data);
+    }
+    list_unpin(partition);
+  }
+}
+
+/* Measures the buckets of every partitionBy in members and merges runs of neighbouring
+ * buckets up to the target size. The members share the hinted number of partitions */
+AdaptivePlan *measure_plan(RDD **members, int cnt, size_t target)
+{
+  AdaptivePlan *plan = malloc(sizeof(AdaptivePlan));
+  plan->buckets = members[0]->partitions_cnt * ADAPTIVE_SPLIT;
+  plan->partition = malloc(sizeof(int) * plan->buckets);
+  size_t *sizes = calloc(plan->buckets, sizeof(size_t));
+  for (int i = 0; i < cnt; i++)
+    measure_buckets(members[i], plan->buckets, sizes);
+
+  // A bucket is the unit of placement, so one above the target gets a partition of its own
+  int pnum = 0;
+  size_t size = 0;
+  for (int i = 0; i < plan->buckets; i++)
+  {
+    if (size > 0 && size + sizes[i] > target)
+    {
+      pnum++;
+      size = 0;
+    }
+    plan->partition[i] = pnum;
+    size += sizes[i];
+  }
+  free(sizes);
+  return plan;
+}
+
+/* Bytes of a materialized partition, sized the same way blocks are charged */
+size_t partition_bytes(List *partition)
+{
+  size_t bytes = 0;
+  list_pin(partition);
+  ListIter iter = list_get_iter(partition);
+  void *data;
+  while ((data = iter_next(&iter)) != NULL)
+    bytes += sizeof(ListNode) + malloc_usable_size(data);
+  list_unpin(partition);
+  return bytes;
+}
+
+int compare_sizes(const void *a, const void *b)
+{
+  size_t x = *(const size_t *)a;
+  size_t y = *(const size_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+/* Splits the parent partitions of a join whose materialized sides hold more than factor
+ * times the median bytes, NULL if none does */
+SkewPlan *skew_plan(RDD *rdd, double factor)
+{
+  int cnt = rdd->dependencies[0]->partitions_cnt;
+  size_t bytes[2][cnt];
+  size_t totals[cnt];
+  size_t sorted[cnt];
+  size_t sum = 0;
+  for (int i = 0; i < cnt; i++)
+  {
+    for (int side = 0; side < 2; side++)
+      bytes[side][i] = partition_bytes(rdd->dependencies[side]->partitions[i]);
+    totals[i] = sorted[i] = bytes[0][i] + bytes[1][i];
+    sum += totals[i];
+  }
+  qsort(sorted, cnt, sizeof(size_t), compare_sizes);
+
+  // With mostly empty partitions the mean stands in for the median
+  size_t base = sorted[cnt / 2] > 0 ? sorted[cnt / 2] : sum / cnt;
+  if (base == 0)
+    return NULL;
+
+  SkewPlan *skew = malloc(sizeof(SkewPlan));
+  skew->pieces = malloc(sizeof(int) * cnt);
+  skew->side = malloc(sizeof(int) * cnt);
+  skew->left = malloc(sizeof(int) * cnt);
+  int numpartitions = 0;
+  for (int i = 0; i < cnt; i++)
+  {
+    // The larger side is split, a piece holds at least one of its items
+    int side = bytes[0][i] >= bytes[1][i] ? 0 : 1;
+    int pieces = 1;
+    if (totals[i] > factor * base)
+    {
+      pieces = (totals[i] + base - 1) / base;
+      pieces = pieces < SKEW_MAX_PIECES ? pieces : SKEW_MAX_PIECES;
+      int items = rdd->dependencies[side]->partitions[i]->num_items;
+      pieces = pieces < items ? pieces : (items > 1 ? items : 1);
+    }
+    skew->pieces[i] = skew->left[i] = pieces;
+    skew->side[i] = side;
+    numpartitions += pieces;
+  }
+  if (numpartitions == cnt)
+  {
+    free(skew->pieces);
+    free(skew->side);
+    free(skew->left);
+    free(skew);
+    return NULL;
+  }
+
+  skew->partition = malloc(sizeof(int) * numpartitions);
+  skew->piece = malloc(sizeof(int) * numpartitions);
+  int pnum = 0;
+  for (int i = 0; i < cnt; i++)
+  {
+    for (int j = 0; j < skew->pieces[i]; j++, pnum++)
+    {
+      skew->partition[pnum] = i;
+      skew->piece[pnum] = j;
+    }
+  }
+  return skew;
+}
+
+void skew_free(SkewPlan *skew)
+{
+  free(skew->partition);
+  free(skew->piece);
+  free(skew->pieces);
+  free(skew->side);
+  free(skew->left);
+  free(skew);
+}
+
+/* Number of partitions of a join planned by skew_plan */
+int skew_partitions(SkewPlan *skew, int cnt)
+{
+  int numpartitions = 0;
+  for (int i = 0; i < cnt; i++)
+    numpartitions += skew->pieces[i];
+  return numpartitions;
+}
+
+/* The partitionBy whose partitions one side of a join keeps, NULL if they come from
+ * anything else */
+RDD *partitioned_source(RDD *rdd)
+{
+  while (rdd->trans != PARTITIONBY)
+  {
+    if (!derived_partitions(rdd) || rdd->skew != NULL)
+      return NULL;
+    rdd = rdd->dependencies[0];
+  }
+  return rdd;
+}
+
+int group_root(int *group, int indx)
+{
+  while (group[indx] != indx)
+    indx = group[indx];
+  return indx;
+}
+
+/* Groups the partitionBy RDDs which the two sides of a join take their partitions from,
+ * a group is planned as one. Partitions which reach a join in any other way are kept */
+void group_joins(RDD **stages, int cnt, int *group, bool *kept)
+{
+  for (int i = 0; i < cnt; i++)
+    group[i] = i;
+  for (int i = 0; i < cnt; i++)
+  {
+    RDD *rdd = stages[i];
+    if (rdd->trans != JOIN)
+      continue;
+    RDD *left = partitioned_source(rdd->dependencies[0]);
+    RDD *right = partitioned_source(rdd->dependencies[1]);
+    int first = left != NULL ? stage_index(stages, cnt, left) : -1;
+    int second = right != NULL ? stage_index(stages, cnt, right) : -1;
+    if (first >= 0 && second >= 0 && left->plan == NULL && right->plan == NULL &&
+        left->partitions_cnt == right->partitions_cnt)
+    {
+      group[group_root(group, first)] = group_root(group, second);
+      continue;
+    }
+    for (int j = 0; j < rdd->dependencies_cnt; j++)
+      fix_partitions(rdd->dependencies[j], stages, cnt, kept);
+  }
+
+  // One kept member keeps the partitions of the whole group
+  for (int i = 0; i < cnt; i++)
+  {
+    if (kept[i])
+      kept[group_root(group, i)] = true;
+  }
+}
+
+/* Measures the buckets of all partitionBy RDDs of a group and gives them one plan, so a
+ * join still finds equal keys of both sides in the same partition */
+void plan_group(RDD **stages, int cnt, int *group, int root, bool *resized, size_t target)
+{
+  RDD *members[cnt];
+  int indices[cnt];
+  int n = 0;
+  for (int i = 0; i < cnt; i++)
+  {
+    if (group_root(group, i) == root)
+    {
+      indices[n] = i;
+      members[n++] = stages[i];
+    }
+  }
+
+  pthread_mutex_lock(&threadpool->queue_mutex);
+  bool adaptive = true;
+  for (int i = 0; i < n; i++)
+  {
+    RDD *rdd = members[i];
+    adaptive = adaptive && rdd->plan == NULL && rdd->partitions_cnt > 0 &&
+               rdd->dependencies[0]->trans != FILE_BACKED && !stage_scheduled(rdd);
+  }
+  pthread_mutex_unlock(&threadpool->queue_mutex);
+  if (!adaptive)
+    return;
+
+  // The map sides run as jobs of their own, then the buckets they produced are measured
+  for (int i = 0; i < n; i++)
+    execute(members[i]->dependencies[0]);
+  AdaptivePlan *plan = measure_plan(members, n, target);
+  int numpartitions = plan->partition[plan->buckets - 1] + 1;
+
+  pthread_mutex_lock(&threadpool->queue_mutex);
+  bool scheduled = false;
+  for (int i = 0; i < n; i++)
+    scheduled = scheduled || stage_scheduled(members[i]);
+  if (scheduled)
+  {
+    // Another job got there first with the hinted partitions
+    free(plan->partition);
+    free(plan);
+  }
+  else
+  {
+    for (int i = 0; i < n; i++)
+    {
+      members[i]->plan = plan;
+      if (numpartitions != members[i]->partitions_cnt)
+      {
+        resize_partitions(members[i], numpartitions);
+        resized[indices[i]] = true;
+      }
+    }
+  }
+  pthread_mutex_unlock(&threadpool->queue_mutex);
+}
+
+void plan_adaptive(RDD *root)
+{
+  pthread_mutex_lock(&adaptive_lock);
+  size_t target = adaptive_target;
+  double factor = skew_factor;
+  pthread_mutex_unlock(&adaptive_lock);
+  if (target == 0 && factor <= 0)
+    return;
+
+  int cnt = 0;
+  int cap = 16;
+  RDD **stages = malloc(sizeof(RDD *) * cap);
+  pthread_mutex_lock(&threadpool->queue_mutex);
+  threadpool->visit_cnt += 1;
+  collect_stages(root, &stages, &cnt, &cap);
+  pthread_mutex_unlock(&threadpool->queue_mutex);
+
+  // Pieces of a join feeding another join would no longer line up with its other side
+  bool *fixed = calloc(cnt, sizeof(bool));
+  for (int i = 0; i < cnt; i++)
+  {
+    if (stages[i]->trans == JOIN)
+    {
+      for (int j = 0; j < stages[i]->dependencies_cnt; j++)
+        fix_partitions(stages[i]->dependencies[j], stages, cnt, fixed);
+    }
+  }
+
+  // A group is planned at its last member in postorder, once the lineage of all of them is
+  // planned. Stages depending on an earlier member wait for it and are visited again
+  int *group = malloc(sizeof(int) * cnt);
+  bool *kept = calloc(cnt, sizeof(bool));
+  group_joins(stages, cnt, group, kept);
+  int *first = malloc(sizeof(int) * cnt);
+  int *last = malloc(sizeof(int) * cnt);
+  for (int i = 0; i < cnt; i++)
+    first[i] = -1;
+  for (int i = 0; i < cnt; i++)
+  {
+    int indx = group_root(group, i);
+    if (first[indx] < 0)
+      first[indx] = i;
+    last[indx] = i;
+  }
+  bool *planned = calloc(cnt, sizeof(bool));
+  bool *waiting = calloc(cnt, sizeof(bool));
+  bool *resized = calloc(cnt, sizeof(bool));
+
+  // In postorder every dependency has its final number of partitions before its consumers
+  for (int i = 0; i < cnt; i++)
+  {
+    RDD *rdd = stages[i];
+    int member = group_root(group, i);
+    bool deps_resized = false;
+    bool deps_waiting = false;
+    for (int j = 0; j < rdd->dependencies_cnt; j++)
+    {
+      int indx = stage_index(stages, cnt, rdd->dependencies[j]);
+      deps_resized = deps_resized || (indx >= 0 && resized[indx]);
+      deps_waiting = deps_waiting || (indx >= 0 && waiting[indx]);
+    }
+    waiting[i] = deps_waiting || (target > 0 && first[member] != last[member] && !kept[member] &&
+                                 !planned[member]);
+
+    pthread_mutex_lock(&threadpool->queue_mutex);
+    if (deps_resized && !stage_scheduled(rdd))
+    {
+      if (rdd->trans == UNION)
+      {
+        // union_sync links the parents' partitions again
+        int numpartitions = 0;
+        for (int j = 0; j < rdd->dependencies_cnt; j++)
+          numpartitions += rdd->dependencies[j]->partitions_cnt;
+        resize_partitions(rdd, numpartitions);
+        resized[i] = true;
+      }
+      else if (rdd->trans == PARTITIONBY)
+      {
+        resize_shuffle(rdd);
+      }
+      else if (derived_partitions(rdd) && rdd->skew == NULL &&
+               rdd->partitions_cnt != rdd->dependencies[0]->partitions_cnt)
+      {
+        resize_partitions(rdd, rdd->dependencies[0]->partitions_cnt);
+        resized[i] = true;
+      }
+    }
+    bool adaptive = target > 0 && rdd->trans == PARTITIONBY && !kept[member] &&
+                    !planned[member] && last[member] == i && !deps_waiting;
+    // Pieces would scatter the keys of a join which declared that it keeps them in place
+    bool skewed = factor > 0 && rdd->trans == JOIN && !fixed[i] && !waiting[i] &&
+                  rdd->skew == NULL && rdd->partitioned == NULL && rdd->partitions_cnt > 0 &&
+                  !stage_scheduled(rdd);
+    for (int j = 0; skewed && j < rdd->dependencies_cnt; j++)
+    {
+      RDD *dep = rdd->dependencies[j];
+      skewed = dep->trans != FILE_BACKED && dep->partitions_cnt == rdd->partitions_cnt;
+    }
+    pthread_mutex_unlock(&threadpool->queue_mutex);
+    if (skewed)
+    {
+      // Both sides are materialized first, their partition sizes decide the layout
+      execute(rdd->dependencies[0]);
+      execute(rdd->dependencies[1]);
+      SkewPlan *skew = skew_plan(rdd, factor);
+      if (skew == NULL)
+        continue;
+      pthread_mutex_lock(&threadpool->queue_mutex);
+      if (stage_scheduled(rdd))
+      {
+        skew_free(skew);
+      }
+      else
+      {
+        rdd->skew = skew;
+        resize_partitions(rdd, skew_partitions(skew, rdd->partitions_cnt));
+        resized[i] = true;
+      }
+      pthread_mutex_unlock(&threadpool->queue_mutex);
+      continue;
+    }
+    if (!adaptive)
+      continue;
+
+    plan_group(stages, cnt, group, member, resized, target);
+    planned[member] = true;
+    if (first[member] < i)
+      i = first[member] - 1;
+  }
+  free(fixed);
+  free(group);
+  free(kept);
+  free(first);
+  free(last);
+  free(planned);
+  free(waiting);
+  free(resized);
+  free(stages);
+}
@@ -0,0 +1,366 @@
+#define _GNU_SOURCE
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "minispark.h"
+
+extern ThreadPool *threadpool;
+
+// Task descriptor sent by the driver. Function and context pointers stay valid in the
+// executors because they are forked from the driver
+typedef struct {
+  void *id; // RDD in the driver, for error messages
+  Transform trans;
+  void *fn;
+  void *ctx;
+  int pnum;
+  int partitions_cnt;
+  Serializer serialize;
+  JoinKey *key;
+  int deps_cnt;
+} TaskHeader;
+
+typedef struct {
+  Transform trans;
+  int partitions_cnt;
+  Deserializer deserialize;
+  Freer freer;
+  int shipped; // number of partitions following
+} DepHeader;
+
+typedef struct {
+  int status; // FRAME_OK or FRAME_FAILED
+  size_t len;
+} FrameHeader;
+
+#define FRAME_OK (1)
+#define FRAME_FAILED (0)
+
+bool write_all(int fd, void *buf, size_t len)
+{
+  char *p = buf;
+  while (len > 0)
+  {
+    ssize_t n = write(fd, p, len);
+    if (n <= 0)
+      return false;
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+bool read_all(int fd, void *buf, size_t len)
+{
+  char *p = buf;
+  while (len > 0)
+  {
+    ssize_t n = read(fd, p, len);
+    if (n <= 0)
+      return false;
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+bool write_frame(int fd, int status, char *buf, size_t len)
+{
+  FrameHeader header = {status, len};
+  return write_all(fd, &header, sizeof(header)) && write_all(fd, buf, len);
+}
+
+/* Reads a frame into a malloced buffer, returns false once the peer is gone */
+bool read_frame(int fd, int *status, char **buf, size_t *len)
+{
+  FrameHeader header;
+  if (!read_all(fd, &header, sizeof(header)))
+    return false;
+  *status = header.status;
+  *len = header.len;
+  *buf = malloc(header.len + 1);
+  return read_all(fd, *buf, header.len);
+}
+
+/* Writes the live items of a partition as a count followed by the items */
+bool write_items(List *list, Serializer serialize, FILE *out)
+{
+  int cnt = 0;
+  ListIter iter = list_get_iter(list);
+  void *data;
+  while (iter_next(&iter) != NULL)
+    cnt++;
+  fwrite(&cnt, sizeof(int), 1, out);
+
+  iter = list_get_iter(list);
+  while ((data = iter_next(&iter)) != NULL)
+  {
+    if (serialize(data, out) == 0)
+      return false;
+  }
+  return true;
+}
+
+List *read_items(Deserializer deserialize, Freer freer, FILE *in)
+{
+  int cnt;
+  if (fread(&cnt, sizeof(int), 1, in) != 1)
+    return NULL;
+  List *list = list_init();
+  for (int i = 0; i < cnt; i++)
+  {
+    void *data = deserialize(in);
+    if (data == NULL)
+    {
+      ListIter iter = list_get_iter(list);
+      while ((data = iter_next(&iter)) != NULL)
+      {
+        if (freer != NULL)
+          freer(data);
+        else
+          free(data);
+      }
+      list_node_free(list);
+      return NULL;
+    }
+    list_add(list, data);
+  }
+  return list;
+}
+
+/* Computes the task described by buf and sends the result. Runs in a process forked for
+ * this task only, so crashes and leaks of user functions stay in there */
+void run_task(int fd, char *buf, size_t len)
+{
+  FILE *in = fmemopen(buf, len, "r");
+  TaskHeader header;
+  if (fread(&header, sizeof(header), 1, in) != 1)
+    _exit(1);
+
+  // Dependencies only carry the partitions this task reads
+  RDD *deps[header.deps_cnt + 1];
+  for (int i = 0; i < header.deps_cnt; i++)
+  {
+    DepHeader dep_header;
+    if (fread(&dep_header, sizeof(dep_header), 1, in) != 1)
+      _exit(1);
+    RDD *dep = create_rdd(0, dep_header.trans, NULL);
+    alloc_partitions(dep, dep_header.partitions_cnt);
+    dep->materialized_cnt = dep_header.partitions_cnt;
+    dep->freer = dep_header.freer;
+    deps[i] = dep;
+
+    for (int j = 0; j < dep_header.shipped; j++)
+    {
+      int pnum;
+      if (fread(&pnum, sizeof(int), 1, in) != 1 || pnum < 0 || pnum >= dep->partitions_cnt)
+        _exit(1);
+      if (dep->trans == FILE_BACKED)
+      {
+        int namelen;
+        if (fread(&namelen, sizeof(int), 1, in) != 1)
+          _exit(1);
+        char *name = calloc(namelen + 1, 1);
+        if (fread(name, 1, namelen, in) != (size_t)namelen)
+          _exit(1);
+        dep->partitions[pnum] = list_init();
+        list_add(dep->partitions[pnum], name);
+      }
+      else if ((dep->partitions[pnum] = read_items(dep_header.deserialize, dep_header.freer, in)) == NULL)
+      {
+        _exit(1);
+      }
+    }
+  }
+  fclose(in);
+
+  RDD *rdd = create_rdd_deps(header.deps_cnt, header.trans, header.fn, deps);
+  alloc_partitions(rdd, header.partitions_cnt);
+  rdd->ctx = header.ctx;
+  rdd->key = header.key;
+
+  bool discarded;
+  List *result = compute_partition(rdd, header.pnum, false, &discarded);
+  if (result == NULL)
+    _exit(1);
+
+  char *out_buf;
+  size_t out_len;
+  FILE *out = open_memstream(&out_buf, &out_len);
+  if (!write_items(result, header.serialize, out))
+    _exit(1);
+  fclose(out);
+  if (!write_frame(fd, FRAME_OK, out_buf, out_len))
+    _exit(1);
+  _exit(0);
+}
+
+/* Main loop of an executor process. Every task runs in its own child process so that
+ * the executor survives crashing user functions */
+void executor_loop(int fd)
+{
+  int status;
+  char *buf;
+  size_t len;
+  while (read_frame(fd, &status, &buf, &len))
+  {
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+      perror("fork");
+      _exit(1);
+    }
+    if (pid == 0)
+      run_task(fd, buf, len);
+    free(buf);
+
+    int wstatus;
+    waitpid(pid, &wstatus, 0);
+    if (!WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != 0)
+    {
+      if (!write_frame(fd, FRAME_FAILED, NULL, 0))
+        break;
+    }
+  }
+  _exit(0);
+}
+
+void cluster_init(int executors)
+{
+  threadpool->executors = calloc(executors, sizeof(Executor));
+  threadpool->executors_cnt = executors;
+
+  // Buffered output would otherwise be flushed by every process
+  fflush(NULL);
+  for (int i = 0; i < executors; i++)
+  {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+    {
+      perror("socketpair");
+      exit(1);
+    }
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+      perror("fork");
+      exit(1);
+    }
+    if (pid == 0)
+    {
+      // Only keep our own end, so that every executor sees the driver leave
+      for (int j = 0; j < i; j++)
+        close(threadpool->executors[j].fd);
+      close(fds[0]);
+      executor_loop(fds[1]);
+    }
+    close(fds[1]);
+    threadpool->executors[i].pid = pid;
+    threadpool->executors[i].fd = fds[0];
+  }
+}
+
+void cluster_destroy()
+{
+  for (int i = 0; i < threadpool->executors_cnt; i++)
+  {
+    close(threadpool->executors[i].fd);
+    waitpid(threadpool->executors[i].pid, NULL, 0);
+  }
+  free(threadpool->executors);
+  threadpool->executors = NULL;
+  threadpool->executors_cnt = 0;
+}
+
+bool remote_eligible(RDD *rdd)
+{
+  // Coalesced partitions only refer to their parents, there is nothing to compute remotely
+  if (rdd->serialize == NULL || rdd->deserialize == NULL || rdd->trans == COALESCE)
+    return false;
+  // Executors don't know the layout of an adaptive partitionBy or a skewed join
+  if (rdd->plan != NULL || rdd->skew != NULL)
+    return false;
+  for (int i = 0; i < rdd->dependencies_cnt; i++)
+  {
+    RDD *dep = rdd->dependencies[i];
+    if (dep->trans == FILE_BACKED)
+    {
+      // Only the mappers know how to read lines out of a file
+      if (rdd->trans != MAP && rdd->trans != FLATMAP && rdd->trans != MAPPARTITIONS)
+        return false;
+    }
+    else if (dep->serialize == NULL || dep->deserialize == NULL)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Ships partition pnum of dep to the task */
+bool ship_partition(RDD *dep, int pnum, FILE *out)
+{
+  fwrite(&pnum, sizeof(int), 1, out);
+  List *partition = dep->partitions[pnum];
+  if (dep->trans == FILE_BACKED)
+  {
+    char *name = list_get(partition, 0);
+    int namelen = strlen(name);
+    fwrite(&namelen, sizeof(int), 1, out);
+    fwrite(name, 1, namelen, out);
+    return true;
+  }
+
+  list_pin(partition);
+  bool ok = write_items(partition, dep->serialize, out);
+  list_unpin(partition);
+  return ok;
+}
+
+List *remote_compute(Executor *executor, RDD *rdd, int pnum)
+{
+  char *buf;
+  size_t len;
+  FILE *out = open_memstream(&buf, &len);
+  TaskHeader header = {rdd, rdd->trans, rdd->fn, rdd->ctx, pnum, rdd->partitions_cnt,
+                       rdd->serialize, rdd->key, rdd->dependencies_cnt};
+  fwrite(&header, sizeof(header), 1, out);
+
+  // partitionBy and the small side of a broadcast are read whole, the others only pnum
+  for (int i = 0; i < rdd->dependencies_cnt; i++)
+  {
+    RDD *dep = rdd->dependencies[i];
+    bool all = rdd->trans == PARTITIONBY || (rdd->trans == BROADCAST && i == 1);
+    DepHeader dep_header = {dep->trans, dep->partitions_cnt, dep->deserialize, dep->freer,
+                            all ? dep->partitions_cnt : 1};
+    fwrite(&dep_header, sizeof(dep_header), 1, out);
+    for (int j = 0; j < dep_header.shipped; j++)
+    {
+      if (!ship_partition(dep, all ? j : pnum, out))
+      {
+        printf("error serializing partition of RDD %p\n", (void *)dep);
+        exit(1);
+      }
+    }
+  }
+  fclose(out);
+
+  int status;
+  bool sent = write_frame(executor->fd, FRAME_OK, buf, len);
+  free(buf);
+  if (!sent || !read_frame(executor->fd, &status, &buf, &len))
+  {
+    printf("lost executor %d\n", executor->pid);
+    exit(1);
+  }
+  if (status != FRAME_OK)
+  {
+    free(buf);
+    return NULL;
+  }
+
+  FILE *in = fmemopen(buf, len, "r");
+  List *result = read_items(rdd->deserialize, rdd->freer, in);
+  fclose(in);
+  free(buf);
+  return result;
+}
@@ -0,0 +1,97 @@
+#define _GNU_SOURCE
+#include "minispark.h"
+
+RDD *coalesce(RDD *dep, int numpartitions)
+{
+  if (dep->trans == FILE_BACKED)
+  {
+    printf("error: coalesce of file backed RDD %p, pass fewer files to RDDFromFiles\n", (void *)dep);
+    exit(1);
+  }
+  RDD *rdd = create_rdd(1, COALESCE, NULL, dep);
+  alloc_partitions(rdd, numpartitions);
+  withSerde(rdd, dep->serialize, dep->deserialize, dep->freer);
+  return rdd;
+}
+
+void group_partitions(long *sizes, int cnt, int numgroups, int *groups)
+{
+  long total = 0;
+  for (int i = 0; i < cnt; i++)
+    total += sizes[i];
+
+  // Run j starts at the first partition whose items begin at or after j / numgroups of the
+  // total. Without any items the partitions themselves are split evenly
+  int indx = 0;
+  long prefix = 0;
+  groups[0] = 0;
+  for (int j = 1; j < numgroups; j++)
+  {
+    if (total == 0)
+    {
+      groups[j] = (long)cnt * j / numgroups;
+      continue;
+    }
+    long target = total * j / numgroups;
+    while (indx < cnt && prefix + sizes[indx] / 2 < target)
+      prefix += sizes[indx++];
+    groups[j] = indx;
+  }
+  groups[numgroups] = cnt;
+}
+
+/* Returns the runs of parent partitions, the first task picks them */
+int *coalesce_groups(RDD *rdd)
+{
+  RDD *dep = rdd->dependencies[0];
+  pthread_mutex_lock(&rdd->lock);
+  if (rdd->groups == NULL)
+  {
+    // Sizes stay as they were materialized, even if blocks were spilled since
+    long sizes[dep->partitions_cnt + 1];
+    pthread_mutex_lock(&dep->lock);
+    for (int i = 0; i < dep->partitions_cnt; i++)
+      sizes[i] = dep->partitions[i]->num_items;
+    pthread_mutex_unlock(&dep->lock);
+    int *groups = malloc(sizeof(int) * (rdd->partitions_cnt + 1));
+    group_partitions(sizes, dep->partitions_cnt, rdd->partitions_cnt, groups);
+    rdd->groups = groups;
+  }
+  int *groups = rdd->groups;
+  pthread_mutex_unlock(&rdd->lock);
+  return groups;
+}
+
+List *coalesce_partition(RDD *rdd, int pnum, bool fresh, bool *discarded)
+{
+  RDD *dep = rdd->dependencies[0];
+  int *groups = coalesce_groups(rdd);
+
+  // Recomputed items are moved into a new list, otherwise the partition is a view over
+  // the whole run, which is neither read nor consumed here
+  List *newpartition = fresh ? list_init() : list_view_init();
+  for (int i = groups[pnum]; i < groups[pnum + 1]; i++)
+  {
+    if (!fresh)
+    {
+      list_view_add_all(newpartition, dep->partitions[i]);
+      continue;
+    }
+    List *input = open_input(dep, i, true);
+    if (input == NULL)
+    {
+      list_free_items(newpartition, dep);
+      return NULL;
+    }
+    ListIter iter = list_get_iter(input);
+    void *data;
+    while ((data = iter_next(&iter)) != NULL)
+      list_add(newpartition, data);
+    close_input(dep, input, true);
+  }
+  if (fresh)
+    return newpartition;
+
+  list_view_finish(newpartition);
+  return claim_partition(rdd, pnum) ? newpartition : discard_partition(rdd, newpartition, discarded);
+}
@@ -0,0 +1,115 @@
+#define _GNU_SOURCE
+#include "minispark.h"
+
+// Open addressing set over the keys of the items seen so far, slots with NULL data are empty
+typedef struct
+{
+  void **slots;
+  unsigned long *hashes;
+  unsigned long mask;
+} KeySet;
+
+/* Sends every key to the partition picked by its hash */
+unsigned long distinct_partitioner(void *arg, int numpartitions, void *ctx)
+{
+  JoinKey *key = ctx;
+  return key->hash(arg, key->ctx) % numpartitions;
+}
+
+RDD *distinct(RDD *dep, JoinKey *key, int numpartitions)
+{
+  // Duplicates within a partition are dropped before they are shuffled
+  RDD *local = create_rdd(1, DISTINCT, NULL, dep);
+  alloc_partitions(local, dep->partitions_cnt);
+  local->key = key;
+  local->partitioned = dep->partitioned;
+  withSerde(local, dep->serialize, dep->deserialize, dep->freer);
+
+  RDD *shuffled = partitionBy(local, distinct_partitioner, numpartitions, key);
+  RDD *rdd = create_rdd(1, DISTINCT, NULL, shuffled);
+  alloc_partitions(rdd, numpartitions);
+  rdd->key = key;
+  rdd->partitioned = shuffled->partitioned;
+  withSerde(rdd, dep->serialize, dep->deserialize, dep->freer);
+  return rdd;
+}
+
+void keyset_init(KeySet *set, int cnt)
+{
+  // At most half full, so probe sequences stay short
+  unsigned long size = 16;
+  while (size < 2 * (unsigned long)cnt)
+    size *= 2;
+  set->slots = calloc(size, sizeof(void *));
+  set->hashes = malloc(size * sizeof(unsigned long));
+  set->mask = size - 1;
+}
+
+/* Adds the key of data, returns false if an equal key was added before */
+bool keyset_add(KeySet *set, JoinKey *key, void *data)
+{
+  unsigned long hash = key->hash(data, key->ctx);
+  unsigned long slot = (mix_hash(hash) >> 32) & set->mask;
+  while (set->slots[slot] != NULL)
+  {
+    if (set->hashes[slot] == hash && key->equals(data, set->slots[slot], key->ctx))
+      return false;
+    slot = (slot + 1) & set->mask;
+  }
+  set->slots[slot] = data;
+  set->hashes[slot] = hash;
+  return true;
+}
+
+void keyset_free(KeySet *set)
+{
+  free(set->slots);
+  free(set->hashes);
+}
+
+List *distinct_partition(RDD *rdd, int pnum, bool fresh, bool *discarded)
+{
+  RDD *dep = rdd->dependencies[0];
+  List *input = open_input(dep, pnum, fresh);
+  if (input == NULL)
+    return NULL;
+
+  int cnt = 0;
+  ListIter iter = list_get_iter(input);
+  while (iter_next(&iter) != NULL)
+    cnt++;
+  KeySet set;
+  keyset_init(&set, cnt);
+
+  // Recomputed items are copied, otherwise the new partition is a view selecting the
+  // first item of every key, like filter does
+  List *newpartition = fresh ? list_init() : list_view_init();
+  if (!fresh)
+    list_view_add(newpartition, input);
+  iter = list_get_iter(input);
+  void *data;
+  while ((data = iter_next(&iter)) != NULL)
+  {
+    if (!keyset_add(&set, rdd->key, data))
+    {
+      if (fresh)
+        free_item(dep, data); // recomputed duplicate
+      continue;
+    }
+    if (fresh)
+      list_add(newpartition, data);
+    else
+      list_view_select(newpartition, iter.slice, iter.index - 1);
+  }
+  keyset_free(&set);
+
+  // Duplicates are handed to distinct, the first items stay in their blocks
+  bool keep = fresh || claim_partition(rdd, pnum);
+  if (!fresh)
+  {
+    list_consume_except(input, newpartition);
+    list_view_finish(newpartition);
+  }
+  close_input(dep, input, fresh);
+  return keep ? newpartition : discard_partition(rdd, newpartition, discarded);
+}
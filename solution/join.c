@@ -0,0 +1,582 @@
+#define _GNU_SOURCE
+#include <malloc.h>
+#include "minispark.h"
+
+extern MemoryManager *memory;
+
+typedef struct JoinEntry
+{
+  void *data;
+  unsigned long hash;
+  struct JoinEntry *next;
+} JoinEntry;
+
+// Chained hash table over the build side of a join
+struct JoinTable
+{
+  JoinEntry **slots;
+  unsigned long mask;
+};
+
+void MS_SetJoinMemory(size_t bytes)
+{
+  pthread_mutex_lock(&memory->lock);
+  memory->join_limit = bytes;
+  pthread_mutex_unlock(&memory->lock);
+}
+
+int MS_JoinSpillCount()
+{
+  pthread_mutex_lock(&memory->lock);
+  int cnt = memory->join_spill_cnt;
+  pthread_mutex_unlock(&memory->lock);
+  return cnt;
+}
+
+RDD *hashJoin(RDD *dep1, RDD *dep2, JoinKey *key, Joiner fn, void *ctx)
+{
+  RDD *rdd = join(dep1, dep2, fn, ctx);
+  rdd->key = key;
+  return rdd;
+}
+
+/* Items of a materialized RDD, -1 if it was not materialized */
+long estimate_items(RDD *rdd)
+{
+  long items = 0;
+  pthread_mutex_lock(&rdd->lock);
+  bool known = rdd->trans != FILE_BACKED && rdd->materialized_cnt == rdd->partitions_cnt;
+  for (int i = 0; known && i < rdd->partitions_cnt; i++)
+    items += rdd->partitions[i]->num_items;
+  pthread_mutex_unlock(&rdd->lock);
+  return known ? items : -1;
+}
+
+/* Items of the inputs in [from, to), -1 if any is unknown */
+long range_items(long *items, int from, int to)
+{
+  long sum = 0;
+  for (int i = from; i < to; i++)
+  {
+    if (items[i] < 0)
+      return -1;
+    sum += items[i];
+  }
+  return sum;
+}
+
+/* Joins rdds[from, to) as two balanced halves, the larger half probes the smaller one */
+RDD *join_tree(RDD **rdds, long *items, int from, int to, JoinKey *key, Joiner fn, void *ctx)
+{
+  if (to - from == 1)
+    return rdds[from];
+  int mid = from + (to - from) / 2;
+  RDD *left = join_tree(rdds, items, from, mid, key, fn, ctx);
+  RDD *right = join_tree(rdds, items, mid, to, key, fn, ctx);
+  long left_items = range_items(items, from, mid);
+  long right_items = range_items(items, mid, to);
+  if (left_items >= 0 && right_items >= 0 && left_items < right_items)
+  {
+    RDD *tmp = left;
+    left = right;
+    right = tmp;
+  }
+  return key != NULL ? hashJoin(left, right, key, fn, ctx) : join(left, right, fn, ctx);
+}
+
+RDD *joinAll(RDD **rdds, int numrdds, JoinKey *key, Joiner fn, void *ctx)
+{
+  if (numrdds < 1)
+  {
+    printf("error: joinAll of no RDDs\n");
+    exit(1);
+  }
+
+  // Insertion sort keeps the order of equal and unknown sizes, unknown ones go last
+  RDD *sorted[numrdds];
+  long items[numrdds];
+  for (int i = 0; i < numrdds; i++)
+  {
+    RDD *rdd = rdds[i];
+    long cnt = estimate_items(rdd);
+    int j = i;
+    while (j > 0 && cnt >= 0 && (items[j - 1] < 0 || items[j - 1] > cnt))
+    {
+      sorted[j] = sorted[j - 1];
+      items[j] = items[j - 1];
+      j--;
+    }
+    sorted[j] = rdd;
+    items[j] = cnt;
+  }
+  return join_tree(sorted, items, 0, numrdds, key, fn, ctx);
+}
+
+/* Partitioners already used the low bits of the user's hash, so buckets and slots
+ * are taken from a scrambled copy of it */
+unsigned long mix_hash(unsigned long hash)
+{
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdUL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+JoinTable *table_init(int cnt)
+{
+  unsigned long size = 16;
+  while (size < (unsigned long)cnt)
+    size *= 2;
+  JoinTable *table = malloc(sizeof(JoinTable));
+  table->slots = calloc(size, sizeof(JoinEntry *));
+  table->mask = size - 1;
+  return table;
+}
+
+void table_insert(JoinTable *table, void *data, unsigned long hash)
+{
+  JoinEntry *entry = malloc(sizeof(JoinEntry));
+  entry->data = data;
+  entry->hash = hash;
+  unsigned long slot = (mix_hash(hash) >> 32) & table->mask;
+  entry->next = table->slots[slot];
+  table->slots[slot] = entry;
+}
+
+/* Joins data from the probe side with every matching entry */
+void table_probe(JoinTable *table, RDD *rdd, void *data, unsigned long hash, List *out)
+{
+  JoinKey *key = rdd->key;
+  unsigned long slot = (mix_hash(hash) >> 32) & table->mask;
+  for (JoinEntry *entry = table->slots[slot]; entry != NULL; entry = entry->next)
+  {
+    if (entry->hash != hash || !key->equals(data, entry->data, key->ctx))
+      continue;
+    void *joined = ((Joiner)rdd->fn)(data, entry->data, rdd->ctx);
+    if (joined != NULL)
+      list_add(out, joined);
+  }
+}
+
+/* Frees the table, and with an owner the items in it, which are copies read back from a bucket */
+void table_free(JoinTable *table, RDD *owner)
+{
+  for (unsigned long i = 0; i <= table->mask; i++)
+  {
+    JoinEntry *entry = table->slots[i];
+    while (entry != NULL)
+    {
+      JoinEntry *next = entry->next;
+      if (owner != NULL)
+        free_item(owner, entry->data);
+      free(entry);
+      entry = next;
+    }
+  }
+  free(table->slots);
+  free(table);
+}
+
+void bucket_write(FILE **bucket, Serializer serialize, void *data)
+{
+  if (*bucket == NULL)
+    *bucket = spill_open();
+  if (serialize(data, *bucket) == 0)
+  {
+    printf("error writing join bucket\n");
+    exit(1);
+  }
+}
+
+/* Reads the next item of a bucket file, NULL at its end */
+void *bucket_read(FILE *bucket, Deserializer deserialize)
+{
+  int c = fgetc(bucket);
+  if (c == EOF)
+    return NULL;
+  ungetc(c, bucket);
+  void *data = deserialize(bucket);
+  if (data == NULL)
+  {
+    printf("error reading join bucket\n");
+    exit(1);
+  }
+  return data;
+}
+
+/* Returns the parent partition a join partition reads, and whether it reads a piece of side */
+int join_source(RDD *rdd, int side, int pnum, bool *piece)
+{
+  SkewPlan *skew = rdd->skew;
+  if (skew == NULL)
+  {
+    *piece = false;
+    return pnum;
+  }
+  int ppnum = skew->partition[pnum];
+  *piece = skew->pieces[ppnum] > 1 && skew->side[ppnum] == side;
+  return ppnum;
+}
+
+List *join_open(RDD *rdd, int side, int pnum, bool fresh, List **input)
+{
+  RDD *dep = rdd->dependencies[side];
+  bool piece;
+  int ppnum = join_source(rdd, side, pnum, &piece);
+  if ((*input = open_input(dep, ppnum, fresh)) == NULL || !piece)
+    return *input;
+
+  // Pieces are runs of consecutive slots, counting consumed ones too, so every piece keeps
+  // its items when blocks are reloaded, and recomputed items come in the same order
+  int pieces = rdd->skew->pieces[ppnum];
+  int from = (long)(*input)->num_items * rdd->skew->piece[pnum] / pieces;
+  int to = (long)(*input)->num_items * (rdd->skew->piece[pnum] + 1) / pieces;
+  if (fresh)
+  {
+    List *list = list_init();
+    int indx = 0;
+    ListIter iter = list_get_iter(*input);
+    void *data;
+    while ((data = iter_next(&iter)) != NULL)
+    {
+      if (indx >= from && indx < to)
+        list_add(list, data);
+      else
+        free_item(dep, data); // recomputed copy which belongs to another piece
+      indx++;
+    }
+    // The piece replaces the recomputed partition
+    list_node_free(*input);
+    *input = list;
+    return list;
+  }
+
+  List *list = list_view_init();
+  int first = list_view_add(list, *input);
+  int slices = (*input)->slices != NULL ? (*input)->slices_cnt : 1;
+  int slot = 0;
+  for (int i = 0; i < slices; i++)
+  {
+    ListSlice *slice = (*input)->slices != NULL ? &(*input)->slices[i] : NULL;
+    List *base = slice != NULL ? slice->base : *input;
+    int indx = 0;
+    for (ListNode *node = base->head; node != NULL; node = node->next, indx++)
+    {
+      if (slice != NULL && slice->bitmap != NULL && !(slice->bitmap[indx / 8] & (1 << (indx % 8))))
+        continue;
+      if (slot >= from && slot < to && node->data != NULL)
+        list_view_select(list, first + i, indx);
+      slot++;
+    }
+  }
+  list_view_finish(list);
+  return list;
+}
+
+void join_consume(RDD *rdd, int side, int pnum, List *list)
+{
+  bool piece;
+  int ppnum = join_source(rdd, side, pnum, &piece);
+  if (rdd->skew == NULL || rdd->skew->pieces[ppnum] == 1 || piece)
+  {
+    list_consume(list);
+    return;
+  }
+
+  // Every piece reads all of this side, the last one is done with it
+  pthread_mutex_lock(&rdd->lock);
+  bool last = --rdd->skew->left[ppnum] == 0;
+  pthread_mutex_unlock(&rdd->lock);
+  if (last)
+    list_consume(list);
+}
+
+void join_close(RDD *rdd, int side, bool fresh, List *list, List *input)
+{
+  if (list != input)
+    list_free(list); // selection of a piece
+  if (fresh)
+    list_free_items(input, rdd->dependencies[side]); // joiners return new items
+  else
+    close_input(rdd->dependencies[side], input, fresh);
+}
+
+List *hash_join(RDD *rdd, int pnum, bool fresh, bool *discarded)
+{
+  JoinKey *key = rdd->key;
+  RDD *probe_dep = rdd->dependencies[0];
+  RDD *build_dep = rdd->dependencies[1];
+  List *newpartition = list_init();
+
+  List *build_input;
+  List *build = join_open(rdd, 1, pnum, fresh, &build_input);
+  if (build == NULL)
+  {
+    list_free(newpartition);
+    return NULL;
+  }
+
+  // Size the build side the same way blocks are charged
+  size_t bytes = 0;
+  int cnt = 0;
+  ListIter iter = list_get_iter(build);
+  void *data;
+  while ((data = iter_next(&iter)) != NULL)
+  {
+    bytes += sizeof(JoinEntry) + malloc_usable_size(data);
+    cnt++;
+  }
+
+  // Grace join: buckets [0, resident) are joined in memory while the inputs are read,
+  // the others are written to disk and joined one by one, each within the limit
+  pthread_mutex_lock(&memory->lock);
+  size_t limit = memory->join_limit;
+  pthread_mutex_unlock(&memory->lock);
+  bool spillable = probe_dep->serialize != NULL && probe_dep->deserialize != NULL &&
+                   build_dep->serialize != NULL && build_dep->deserialize != NULL;
+  int nbuckets = 1;
+  int resident = 1;
+  if (limit > 0 && bytes > limit && spillable)
+  {
+    nbuckets = (2 * bytes + limit - 1) / limit;
+    size_t per_bucket = bytes / nbuckets + 1;
+    int fit = limit / per_bucket;
+    resident = fit < nbuckets - 1 ? fit : nbuckets - 1;
+  }
+  FILE *build_buckets[nbuckets];
+  FILE *probe_buckets[nbuckets];
+  for (int i = 0; i < nbuckets; i++)
+  {
+    build_buckets[i] = NULL;
+    probe_buckets[i] = NULL;
+  }
+
+  JoinTable *table = table_init(cnt * resident / nbuckets);
+  iter = list_get_iter(build);
+  while ((data = iter_next(&iter)) != NULL)
+  {
+    unsigned long hash = key->hash(data, key->ctx);
+    int bucket = mix_hash(hash) % nbuckets;
+    if (bucket < resident)
+      table_insert(table, data, hash);
+    else
+      bucket_write(&build_buckets[bucket], build_dep->serialize, data);
+  }
+
+  // Without resident buckets nothing points into the build side anymore, so it may be evicted
+  if (resident == 0)
+    join_close(rdd, 1, fresh, build, build_input);
+
+  List *probe_input;
+  List *probe = join_open(rdd, 0, pnum, fresh, &probe_input);
+  if (probe == NULL)
+  {
+    if (resident > 0)
+      join_close(rdd, 1, fresh, build, build_input);
+    table_free(table, NULL);
+    for (int i = 0; i < nbuckets; i++)
+    {
+      if (build_buckets[i] != NULL)
+        fclose(build_buckets[i]);
+    }
+    list_free(newpartition);
+    return NULL;
+  }
+  iter = list_get_iter(probe);
+  while ((data = iter_next(&iter)) != NULL)
+  {
+    unsigned long hash = key->hash(data, key->ctx);
+    int bucket = mix_hash(hash) % nbuckets;
+    if (bucket < resident)
+      table_probe(table, rdd, data, hash, newpartition);
+    else if (build_buckets[bucket] != NULL)
+      bucket_write(&probe_buckets[bucket], probe_dep->serialize, data);
+  }
+  table_free(table, NULL);
+
+  // Joiners return new items, so the copies read back from the buckets are freed
+  int spilled = 0;
+  for (int i = resident; i < nbuckets; i++)
+  {
+    if (build_buckets[i] == NULL)
+      continue;
+    spilled++;
+    if (probe_buckets[i] != NULL)
+    {
+      table = table_init(cnt / nbuckets);
+      rewind(build_buckets[i]);
+      while ((data = bucket_read(build_buckets[i], build_dep->deserialize)) != NULL)
+        table_insert(table, data, key->hash(data, key->ctx));
+
+      rewind(probe_buckets[i]);
+      while ((data = bucket_read(probe_buckets[i], probe_dep->deserialize)) != NULL)
+      {
+        table_probe(table, rdd, data, key->hash(data, key->ctx), newpartition);
+        free_item(probe_dep, data);
+      }
+      table_free(table, build_dep);
+      fclose(probe_buckets[i]);
+    }
+    fclose(build_buckets[i]);
+  }
+  if (spilled > 0)
+  {
+    pthread_mutex_lock(&memory->lock);
+    memory->join_spill_cnt += spilled;
+    pthread_mutex_unlock(&memory->lock);
+  }
+
+  bool keep = fresh || claim_partition(rdd, pnum);
+  if (!fresh)
+  {
+    join_consume(rdd, 0, pnum, probe);
+    join_consume(rdd, 1, pnum, build);
+  }
+  join_close(rdd, 0, fresh, probe, probe_input);
+  if (resident > 0)
+    join_close(rdd, 1, fresh, build, build_input);
+  if (keep)
+    return newpartition;
+
+  // Joined items are new, so the losing copy of a task frees them
+  list_free_items(newpartition, rdd);
+  *discarded = true;
+  return NULL;
+}
+
+RDD *broadcastJoin(RDD *big, RDD *small, JoinKey *key, Joiner fn, void *ctx)
+{
+  RDD *rdd = create_rdd(2, BROADCAST, fn, big, small);
+  alloc_partitions(rdd, big->partitions_cnt);
+  rdd->ctx = ctx;
+  rdd->key = key;
+  rdd->shared_left = big->partitions_cnt;
+  return rdd;
+}
+
+/* Builds a table over every partition of the small side */
+JoinTable *broadcast_table(RDD *rdd, List **inputs)
+{
+  RDD *small = rdd->dependencies[1];
+  int cnt = 0;
+  for (int i = 0; i < small->partitions_cnt; i++)
+    cnt += inputs[i]->num_items;
+
+  JoinTable *table = table_init(cnt);
+  for (int i = 0; i < small->partitions_cnt; i++)
+  {
+    ListIter iter = list_get_iter(inputs[i]);
+    void *data;
+    while ((data = iter_next(&iter)) != NULL)
+      table_insert(table, data, rdd->key->hash(data, rdd->key->ctx));
+  }
+  return table;
+}
+
+/* Returns the shared table, the first task builds it and pins the small side */
+JoinTable *broadcast_acquire(RDD *rdd)
+{
+  RDD *small = rdd->dependencies[1];
+  pthread_mutex_lock(&rdd->lock);
+  while (rdd->building)
+    pthread_cond_wait(&rdd->built, &rdd->lock);
+  rdd->shared_users += 1;
+  if (rdd->table == NULL)
+  {
+    // The scheduler takes the lock to look at the partitions, so it is not held while the
+    // whole small side is read; as a user the builder keeps the table from being dropped
+    rdd->building = true;
+    pthread_mutex_unlock(&rdd->lock);
+    for (int i = 0; i < small->partitions_cnt; i++)
+      list_pin(small->partitions[i]);
+    JoinTable *table = broadcast_table(rdd, small->partitions);
+    pthread_mutex_lock(&rdd->lock);
+    rdd->table = table;
+    rdd->building = false;
+    pthread_cond_broadcast(&rdd->built);
+  }
+  JoinTable *table = rdd->table;
+  pthread_mutex_unlock(&rdd->lock);
+  return table;
+}
+
+/* Drops the table once every partition was claimed and nobody probes it anymore */
+void broadcast_release(RDD *rdd, bool claimed)
+{
+  RDD *small = rdd->dependencies[1];
+  pthread_mutex_lock(&rdd->lock);
+  rdd->shared_users -= 1;
+  if (claimed)
+    rdd->shared_left -= 1;
+  if (rdd->shared_left == 0 && rdd->shared_users == 0 && rdd->table != NULL)
+  {
+    table_free(rdd->table, NULL);
+    rdd->table = NULL;
+    for (int i = 0; i < small->partitions_cnt; i++)
+      list_unpin(small->partitions[i]);
+  }
+  pthread_mutex_unlock(&rdd->lock);
+}
+
+List *broadcast_join(RDD *rdd, int pnum, bool fresh, bool *discarded)
+{
+  RDD *big = rdd->dependencies[0];
+  RDD *small = rdd->dependencies[1];
+  List *probe = open_input(big, pnum, fresh);
+  if (probe == NULL)
+    return NULL;
+
+  // A recomputed partition can not rely on the shared table, so it builds its own
+  JoinTable *table;
+  List *inputs[small->partitions_cnt];
+  if (fresh)
+  {
+    for (int i = 0; i < small->partitions_cnt; i++)
+    {
+      if ((inputs[i] = open_input(small, i, true)) == NULL)
+      {
+        while (--i >= 0)
+          list_free_items(inputs[i], small);
+        close_input(big, probe, fresh);
+        return NULL;
+      }
+    }
+    table = broadcast_table(rdd, inputs);
+  }
+  else
+  {
+    table = broadcast_acquire(rdd);
+  }
+
+  List *newpartition = list_init();
+  ListIter iter = list_get_iter(probe);
+  void *data;
+  while ((data = iter_next(&iter)) != NULL)
+    table_probe(table, rdd, data, rdd->key->hash(data, rdd->key->ctx), newpartition);
+
+  // The small side is shared, only the big side is consumed
+  bool keep = fresh || claim_partition(rdd, pnum);
+  if (fresh)
+  {
+    table_free(table, NULL);
+    for (int i = 0; i < small->partitions_cnt; i++)
+      list_free_items(inputs[i], small);
+  }
+  else
+  {
+    // Speculative copies build their own table, so the original settles its partition
+    // even when it loses
+    list_consume(probe);
+    broadcast_release(rdd, true);
+  }
+  if (fresh)
+    list_free_items(probe, big); // joiners return new items
+  else
+    close_input(big, probe, fresh);
+  if (keep)
+    return newpartition;
+
+  list_free_items(newpartition, rdd);
+  *discarded = true;
+  return NULL;
+}
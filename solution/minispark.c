@@ -3,6 +3,8 @@
 
 ThreadPool *threadpool;
 FILE *fn;
+__thread SchedPool *current_pool = NULL;
+__thread Executor *current_executor = NULL; // process running this worker's tasks in cluster mode
 
 // Working with metrics...
 // Recording the current time in a `struct timespec`:
@@ -11,11 +13,18 @@ FILE *fn;
 //    duration = TIME_DIFF_MICROS(metric->created, metric->scheduled);
 // Use `print_formatted_metric(...)` to write a metric to the logfile. 
 void print_formatted_metric(TaskMetric* metric, FILE* fp) {
-  fprintf(fp, "RDD %p Part %d Trans %d -- creation %10jd.%06ld, scheduled %10jd.%06ld, execution (usec) %ld\n",
+  fprintf(fp, "RDD %p Part %d Trans %d -- creation %10jd.%06ld, scheduled %10jd.%06ld, execution (usec) %ld, items %d\n",
 	  metric->rdd, metric->pnum, metric->rdd->trans,
 	  metric->created.tv_sec, metric->created.tv_nsec / 1000,
 	  metric->scheduled.tv_sec, metric->scheduled.tv_nsec / 1000,
-	  metric->duration);
+	  metric->duration, metric->items);
+}
+
+void print_formatted_job_metric(JobMetric* metric, FILE* fp) {
+  fprintf(fp, "Job %d Pool %s -- submitted %10jd.%06ld, tasks %d, queue wait (usec) avg %ld max %ld, execution (usec) %ld\n",
+	  metric->jobid, metric->pool,
+	  metric->submitted.tv_sec, metric->submitted.tv_nsec / 1000,
+	  metric->tasks, metric->wait_avg, metric->wait_max, metric->duration);
 }
 
 int max(int a, int b)
@@ -25,24 +34,24 @@ int max(int a, int b)
 
 RDD *create_rdd(int numdeps, Transform t, void *fn, ...)
 {
-  RDD *rdd = malloc(sizeof(RDD));
-  if (rdd == NULL)
-  {
-    printf("error mallocing new rdd\n");
-    exit(1);
-  }
-
+  RDD *deps[numdeps + 1];
   va_list args;
   va_start(args, fn);
-
-  int maxpartitions = 0;
   for (int i = 0; i < numdeps; i++)
+    deps[i] = va_arg(args, RDD *);
+  va_end(args);
+  return create_rdd_deps(numdeps, t, fn, deps);
+}
+
+RDD *create_rdd_deps(int numdeps, Transform t, void *fn, RDD **deps)
+{
+  RDD *rdd = malloc(sizeof(RDD));
+  if (rdd == NULL || (rdd->dependencies = malloc(sizeof(RDD *) * (numdeps + 1))) == NULL)
   {
-    RDD *dep = va_arg(args, RDD *);
-    rdd->dependencies[i] = dep;
-    maxpartitions = max(maxpartitions, dep->partitions_cnt);
+    printf("error mallocing new rdd\n");
+    exit(1);
   }
-  va_end(args);
+  memcpy(rdd->dependencies, deps, sizeof(RDD *) * numdeps);
 
   rdd->dependencies_cnt = numdeps;
   rdd->trans = t;
@@ -52,45 +61,187 @@ RDD *create_rdd(int numdeps, Transform t, void *fn, ...)
   rdd->partitions_cnt = 0;
   pthread_mutex_init(&rdd->lock, NULL);
   rdd->materialized_cnt = 0;
+  rdd->scheduled = NULL;
+  rdd->claimed = NULL;
+  rdd->fused = false;
+  rdd->serialize = NULL;
+  rdd->deserialize = NULL;
+  rdd->freer = NULL;
+  rdd->shuffle = NULL;
+  rdd->key = NULL;
+  rdd->partitioned = NULL;
+  rdd->table = NULL;
+  rdd->bounds = NULL;
+  rdd->bounds_cnt = 0;
+  rdd->ranges = NULL;
+  rdd->groups = NULL;
+  rdd->plan = NULL;
+  rdd->skew = NULL;
+  rdd->shared_users = 0;
+  rdd->building = false;
+  pthread_cond_init(&rdd->built, NULL);
+  rdd->shared_left = 0;
+  rdd->rank = 0;
+  rdd->duration_total = 0;
+  rdd->duration_cnt = 0;
+  rdd->durations = NULL;
+  rdd->durations_cnt = 0;
+  rdd->visit = 0;
   return rdd;
 }
 
+/* Allocates partition bookkeeping once the number of partitions is known */
+void alloc_partitions(RDD *rdd, int numpartitions)
+{
+  rdd->partitions = calloc(numpartitions, sizeof(List *));
+  rdd->scheduled = calloc(numpartitions, sizeof(bool));
+  rdd->claimed = calloc(numpartitions, sizeof(bool));
+  rdd->durations = calloc(numpartitions, sizeof(size_t));
+  rdd->partitions_cnt = numpartitions;
+}
+
 /* RDD constructors */
 RDD *map(RDD *dep, Mapper fn)
 {
   RDD *rdd = create_rdd(1, MAP, fn, dep);
-  rdd->partitions = malloc(sizeof(List *) * rdd->dependencies[0]->partitions_cnt);
-  rdd->partitions_cnt = rdd->dependencies[0]->partitions_cnt;
+  alloc_partitions(rdd, rdd->dependencies[0]->partitions_cnt);
   return rdd;
 }
 
 RDD *filter(RDD *dep, Filter fn, void *ctx)
 {
   RDD *rdd = create_rdd(1, FILTER, fn, dep);
-  rdd->partitions = malloc(sizeof(List *) * rdd->dependencies[0]->partitions_cnt);
-  rdd->partitions_cnt = rdd->dependencies[0]->partitions_cnt;
+  alloc_partitions(rdd, rdd->dependencies[0]->partitions_cnt);
+  rdd->ctx = ctx;
+  rdd->partitioned = dep->partitioned;
+  withSerde(rdd, dep->serialize, dep->deserialize, dep->freer);
+  return rdd;
+}
+
+RDD *flatMap(RDD *dep, FlatMapper fn, void *ctx)
+{
+  RDD *rdd = create_rdd(1, FLATMAP, fn, dep);
+  alloc_partitions(rdd, rdd->dependencies[0]->partitions_cnt);
+  rdd->ctx = ctx;
+  return rdd;
+}
+
+RDD *mapPartitions(RDD *dep, PartitionFn fn, void *ctx)
+{
+  RDD *rdd = create_rdd(1, MAPPARTITIONS, fn, dep);
+  alloc_partitions(rdd, rdd->dependencies[0]->partitions_cnt);
   rdd->ctx = ctx;
   return rdd;
 }
 
 RDD *partitionBy(RDD *dep, Partitioner fn, int numpartitions, void *ctx)
 {
+  // Items already are where this shuffle would send them
+  RDD *source = dep->partitioned;
+  if (source != NULL && source->fn == (void *)fn && source->ctx == ctx &&
+      source->plan == NULL && source->partitions_cnt == numpartitions)
+    return dep;
+
   RDD *rdd = create_rdd(1, PARTITIONBY, fn, dep);
-  rdd->partitions = malloc(sizeof(List *) * numpartitions);
-  rdd->partitions_cnt = numpartitions;
+  alloc_partitions(rdd, numpartitions);
+  rdd->shuffle = shuffle_alloc(dep->partitions_cnt);
   rdd->ctx = ctx;
+  rdd->partitioned = rdd;
+  withSerde(rdd, dep->serialize, dep->deserialize, dep->freer);
   return rdd;
 }
 
+RDD *preservesPartitioning(RDD *rdd)
+{
+  if (rdd->trans != MAP && rdd->trans != FLATMAP && rdd->trans != MAPPARTITIONS && rdd->trans != JOIN)
+  {
+    printf("error: RDD %p can not declare that it preserves partitioning\n", (void *)rdd);
+    exit(1);
+  }
+  rdd->partitioned = rdd->dependencies[0]->partitioned;
+  return rdd;
+}
+
+bool co_partitioned(RDD *rdd)
+{
+  // Adaptive plans depend on the measured data, so only a shared plan matches
+  RDD *source1 = rdd->dependencies[0]->partitioned;
+  RDD *source2 = rdd->dependencies[1]->partitioned;
+  if (source1 == NULL || source2 == NULL)
+    return false;
+  if (source1 == source2)
+    return true;
+  return source1->fn == source2->fn && source1->ctx == source2->ctx &&
+         source1->plan == source2->plan && source1->partitions_cnt == source2->partitions_cnt;
+}
+
 RDD *join(RDD *dep1, RDD *dep2, Joiner fn, void *ctx)
 {
   RDD *rdd = create_rdd(2, JOIN, fn, dep1, dep2);
-  rdd->partitions = malloc(sizeof(List *) * rdd->dependencies[0]->partitions_cnt);
-  rdd->partitions_cnt = rdd->dependencies[0]->partitions_cnt;
+  alloc_partitions(rdd, rdd->dependencies[0]->partitions_cnt);
   rdd->ctx = ctx;
   return rdd;
 }
 
+RDD *unionRDDs(RDD **rdds, int numrdds)
+{
+  // Parents which are unions themselves contribute their own parents, so the DAG stays flat
+  int cnt = 0;
+  for (int i = 0; i < numrdds; i++)
+    cnt += rdds[i]->trans == UNION ? rdds[i]->dependencies_cnt : 1;
+  RDD *deps[cnt + 1];
+  int numpartitions = 0;
+  cnt = 0;
+  for (int i = 0; i < numrdds; i++)
+  {
+    int parents = rdds[i]->trans == UNION ? rdds[i]->dependencies_cnt : 1;
+    for (int j = 0; j < parents; j++)
+    {
+      RDD *dep = rdds[i]->trans == UNION ? rdds[i]->dependencies[j] : rdds[i];
+      if (dep->trans == FILE_BACKED)
+      {
+        printf("error: union of file backed RDD %p, pass all files to RDDFromFiles\n", (void *)dep);
+        exit(1);
+      }
+      deps[cnt++] = dep;
+      numpartitions += dep->partitions_cnt;
+    }
+  }
+
+  RDD *rdd = create_rdd_deps(cnt, UNION, NULL, deps);
+  alloc_partitions(rdd, numpartitions);
+
+  // Items can only be spilled if every parent agrees on how
+  bool same = cnt > 0;
+  for (int i = 1; i < cnt; i++)
+    same = same && deps[i]->serialize == deps[0]->serialize && deps[i]->deserialize == deps[0]->deserialize;
+  if (same)
+    withSerde(rdd, deps[0]->serialize, deps[0]->deserialize, deps[0]->freer);
+  union_sync(rdd);
+  return rdd;
+}
+
+void union_sync(RDD *rdd)
+{
+  pthread_mutex_lock(&rdd->lock);
+  int pnum = 0;
+  for (int i = 0; i < rdd->dependencies_cnt && rdd->materialized_cnt < rdd->partitions_cnt; i++)
+  {
+    RDD *dep = rdd->dependencies[i];
+    pthread_mutex_lock(&dep->lock);
+    for (int j = 0; j < dep->partitions_cnt; j++, pnum++)
+    {
+      if (rdd->partitions[pnum] == NULL && dep->partitions[j] != NULL)
+      {
+        rdd->partitions[pnum] = dep->partitions[j];
+        rdd->materialized_cnt += 1;
+      }
+    }
+    pthread_mutex_unlock(&dep->lock);
+  }
+  pthread_mutex_unlock(&rdd->lock);
+}
+
 /* A special mapper */
 void *identity(void *arg)
 {
@@ -101,16 +252,11 @@ void *identity(void *arg)
  * By convention, this is how we read from input files. */
 RDD *RDDFromFiles(char **filenames, int numfiles)
 {
-  RDD *rdd = malloc(sizeof(RDD));
-  rdd->dependencies_cnt = 0;
-  rdd->trans = FILE_BACKED;
-  rdd->fn = (void *)identity;
-  rdd->ctx = NULL;
-  rdd->partitions = malloc(sizeof(List *) * numfiles);
-  rdd->partitions_cnt = numfiles;
-  pthread_mutex_init(&rdd->lock, NULL);
+  RDD *rdd = create_rdd(0, FILE_BACKED, (void *)identity);
+  alloc_partitions(rdd, numfiles);
   rdd->materialized_cnt = numfiles;
 
+  // Partitions keep the file names, files are opened by every task reading them
   for (int i = 0; i < numfiles; i++)
   {
     FILE *fp = fopen(filenames[i], "r");
@@ -118,71 +264,245 @@ RDD *RDDFromFiles(char **filenames, int numfiles)
       perror("fopen");
       exit(1);
     }
+    fclose(fp);
     rdd->partitions[i] = list_init();
-    list_add(rdd->partitions[i], fp);
+    list_add(rdd->partitions[i], strdup(filenames[i]));
   }
   return rdd;
 }
 
-Task* create_task(RDD *rdd, int pnum, bool finalrdd)
+Task* create_task(RDD *rdd, int pnum, bool finalrdd, Job *job)
 {
   // Initialize rdd, pnum, and finalrdd for the task
   Task *task = malloc(sizeof(Task));
   task->rdd = rdd;
   task->pnum = pnum;
   task->finalrdd = finalrdd;
+  task->job = job;
+  task->attempts = 0;
+  task->rank = 0;
+  task->speculative = false;
+  task->discarded = false;
+  task->twin = NULL;
 
   // Initialize metric for the task
   TaskMetric *metric = malloc(sizeof(TaskMetric));
   metric->pnum = pnum;
   metric->rdd = rdd;
+  metric->items = 0;
+  metric->job = NULL;
   clock_gettime(CLOCK_MONOTONIC, &metric->created);
   task->metric = metric;
   return task;
 }
 
-void submit_tasks(RDD *rdd, bool final)
+/* Must be called with queue_mutex held. Partitions which were already handed to
+ * this or another job are skipped, so shared lineage is materialized only once */
+void submit_tasks(Job *job, RDD *rdd, bool final)
 {
-  // Check current RDD
-  if (rdd->trans != FILE_BACKED)
+  // Check current RDD, unions only need their parents
+  if (rdd->trans != FILE_BACKED && rdd->trans != UNION)
   {
     for (int i = 0; i < rdd->partitions_cnt; i++)
     {
-      Task *task = create_task(rdd, i, final);
-      queue_push(threadpool->queue, task);
+      if (rdd->scheduled[i])
+        continue;
+      rdd->scheduled[i] = true;
+      Task *task = create_task(rdd, i, final, job);
+      queue_push(job->queue, task);
+      job->pending += 1;
     }
   }
-  else
+  if (rdd->trans == FILE_BACKED || rdd->fused)
+    return;
+
+  // Do recursion on each dependency
+  for (int i = 0; i < rdd->dependencies_cnt; i++)
   {
+    submit_tasks(job, rdd->dependencies[i], false);
+  }
+}
+
+long stage_cost(RDD *rdd)
+{
+  if (rdd->trans == UNION)
+    return 0;
+  if (rdd->duration_cnt > 0)
+    return rdd->duration_total / rdd->duration_cnt + 1;
+  if (threadpool->duration_cnt > 0)
+    return threadpool->duration_total / threadpool->duration_cnt + 1;
+  return 1;
+}
+
+/* Collects stages reachable from rdd in postorder (dependencies before consumers) */
+void collect_stages(RDD *rdd, RDD ***stages, int *cnt, int *cap)
+{
+  if (rdd->trans == FILE_BACKED || rdd->visit == threadpool->visit_cnt)
     return;
+  rdd->visit = threadpool->visit_cnt;
+
+  for (int i = 0; i < rdd->dependencies_cnt; i++)
+    collect_stages(rdd->dependencies[i], stages, cnt, cap);
+
+  if (*cnt == *cap)
+  {
+    *cap *= 2;
+    *stages = realloc(*stages, sizeof(RDD *) * *cap);
   }
+  (*stages)[(*cnt)++] = rdd;
+}
 
-  // Do recursion on each dependency
+void rank_job(Job *job)
+{
+  int cnt = 0;
+  int cap = 16;
+  RDD **stages = malloc(sizeof(RDD *) * cap);
+  threadpool->visit_cnt += 1;
+  collect_stages(job->root, &stages, &cnt, &cap);
+
+  // In reverse postorder every consumer is ranked before its dependencies, so rank
+  // temporarily holds the longest path from the stage's consumers to the end of the job
+  for (int i = 0; i < cnt; i++)
+    stages[i]->rank = 0;
+  for (int i = cnt - 1; i >= 0; i--)
+  {
+    RDD *rdd = stages[i];
+    rdd->rank += stage_cost(rdd);
+    for (int j = 0; j < rdd->dependencies_cnt; j++)
+    {
+      RDD *dep = rdd->dependencies[j];
+      if (dep->trans != FILE_BACKED && dep->rank < rdd->rank)
+        dep->rank = rdd->rank;
+    }
+  }
+  free(stages);
+
+  // Stages may be shared with other jobs, so the ranks are kept by this job's tasks
+  for (ListNode *node = job->queue->head; node != NULL; node = node->next)
+  {
+    Task *task = node->data;
+    task->rank = task->rdd->rank;
+  }
+}
+
+Job *job_init(SchedPool *pool)
+{
+  Job *job = malloc(sizeof(Job));
+  job->pool = pool;
+  job->queue = queue_init();
+  job->pending = 0;
+  job->running = 0;
+  job->active = list_init();
+  job->awaited = NULL;
+  job->awaited_cnt = 0;
+  job->done = false;
+  job->detached = false;
+  job->tasks_cnt = 0;
+  job->wait_total = 0;
+  job->wait_max = 0;
+  clock_gettime(CLOCK_MONOTONIC, &job->submitted);
+  return job;
+}
+
+void job_free(Job *job)
+{
+  list_free(job->active);
+  free(job->awaited);
+  free(job->queue);
+  free(job);
+}
+
+/* Must be called with queue_mutex held, before the job's tasks are submitted. Records the
+ * partitions of the root which were handed to an earlier job that did not finish them */
+void await_partitions(Job *job, RDD *rdd)
+{
+  job->awaited = malloc(sizeof(int) * (rdd->partitions_cnt + 1));
+  if (rdd->trans != UNION)
+  {
+    pthread_mutex_lock(&rdd->lock);
+    for (int i = 0; i < rdd->partitions_cnt; i++)
+    {
+      if (rdd->scheduled[i] && rdd->partitions[i] == NULL)
+        job->awaited[job->awaited_cnt++] = i;
+    }
+    pthread_mutex_unlock(&rdd->lock);
+    return;
+  }
+
+  // Partitions of a union are those of its parents
+  int pnum = 0;
   for (int i = 0; i < rdd->dependencies_cnt; i++)
   {
-    submit_tasks(rdd->dependencies[i], false);
+    RDD *dep = rdd->dependencies[i];
+    pthread_mutex_lock(&dep->lock);
+    for (int j = 0; j < dep->partitions_cnt; j++, pnum++)
+    {
+      if (dep->scheduled[j] && dep->partitions[j] == NULL)
+        job->awaited[job->awaited_cnt++] = pnum;
+    }
+    pthread_mutex_unlock(&dep->lock);
   }
 }
 
+/* Called with work_mutex held, true once every awaited partition is materialized */
+bool awaited_ready(Job *job)
+{
+  RDD *rdd = job->root;
+  if (rdd->trans == UNION)
+    union_sync(rdd);
+  bool ready = true;
+  pthread_mutex_lock(&rdd->lock);
+  for (int i = 0; i < job->awaited_cnt && ready; i++)
+    ready = rdd->partitions[job->awaited[i]] != NULL;
+  pthread_mutex_unlock(&rdd->lock);
+  return ready;
+}
+
 void execute(RDD* rdd) {
   // Check if top level is not file backed
   if (rdd->trans == FILE_BACKED)
     return;
+  plan_adaptive(rdd);
+
+  Job *job = job_init(current_pool != NULL ? current_pool : threadpool->default_pool);
+
+  // Submit tasks to the job queue and do signal
+  pthread_mutex_lock(&threadpool->queue_mutex);
+  job->id = threadpool->jobs_cnt++;
+  job->root = rdd;
+  await_partitions(job, rdd);
+  submit_tasks(job, rdd, true);
+  bool submitted = job->pending > 0;
+  if (submitted)
+  {
+    list_add(job->pool->jobs, job);
+    rank_job(job);
+  }
+  pthread_mutex_unlock(&threadpool->queue_mutex);
+  if (submitted)
+    pthread_cond_broadcast(&threadpool->new_work);
 
-  // Submit tasks to the queue and do signal
-  submit_tasks(rdd, true);
-
-  pthread_mutex_lock(&threadpool->work_mutex);
-  threadpool->started = true;
-  pthread_mutex_unlock(&threadpool->work_mutex);
-  pthread_cond_broadcast(&threadpool->work_start);
-
-  // Wait until the result is finished
+  // Wait until the result is finished, partitions computed by an earlier job included
   pthread_mutex_lock(&threadpool->work_mutex);
-  while (threadpool->started)
+  if (job->awaited_cnt > 0)
+    threadpool->awaiting += 1;
+  while ((submitted && !job->done) || !awaited_ready(job))
     pthread_cond_wait(&threadpool->work_ready, &threadpool->work_mutex);
+  if (job->awaited_cnt > 0)
+    threadpool->awaiting -= 1;
   pthread_mutex_unlock(&threadpool->work_mutex);
 
+  // Speculative losers may still be running, the last one frees the job
+  pthread_mutex_lock(&threadpool->queue_mutex);
+  bool idle = job->active->num_items == 0;
+  job->detached = !idle;
+  pthread_mutex_unlock(&threadpool->queue_mutex);
+  if (idle)
+    job_free(job);
+
+  // A union has no tasks of its own, its partitions are the ones its parents just produced
+  if (rdd->trans == UNION)
+    union_sync(rdd);
   return;
 }
 
@@ -190,15 +510,9 @@ int count(RDD *rdd) {
   execute(rdd);
 
   int count = 0;
-  // count all the items in rdd
+  // count all the items in rdd, which doesn't require spilled partitions to be read back
   for (int i = 0; i < rdd->partitions_cnt; i++)
-  {
-    List *partition = rdd->partitions[i];
-    ListIter iter = list_get_iter(partition);
-    void *data;
-    while ((data = iter_next(&iter)) != NULL)
-      count += 1;
-  }
+    count += rdd->partitions[i]->num_items;
   return count;
 }
 
@@ -209,14 +523,21 @@ void print(RDD *rdd, Printer p) {
   for (int i = 0; i < rdd->partitions_cnt; i++)
   {
     List *partition = rdd->partitions[i];
+    list_pin(partition);
     ListIter iter = list_get_iter(partition);
     void *data;
     while ((data = iter_next(&iter)) != NULL)
       p(data);
+    list_unpin(partition);
   }
 }
 
 void MS_Run()
+{
+    MS_RunCluster(0);
+}
+
+void MS_RunCluster(int executors)
 {
     // Open file for logging
     fn = fopen("metrics.log", "w+");
@@ -229,16 +550,25 @@ void MS_Run()
     pthread_mutex_init(&threadpool->work_mutex, NULL);
     pthread_mutex_init(&threadpool->monitor_mutex, NULL);
 
-    pthread_cond_init(&threadpool->work_start, NULL);
     pthread_cond_init(&threadpool->work_ready, NULL);
     pthread_cond_init(&threadpool->new_work, NULL);
     pthread_cond_init(&threadpool->new_monitor, NULL);
 
-    threadpool->started = false;
     threadpool->shutdown = false;
 
-    // Initialize the workqueue
-    threadpool->queue = queue_init();
+    memory_init();
+
+    // Initialize the scheduling pools, jobs go to the default one unless told otherwise
+    threadpool->pools = list_init();
+    threadpool->mode = POOL_FIFO;
+    threadpool->jobs_cnt = 0;
+    threadpool->awaiting = 0;
+    threadpool->visit_cnt = 0;
+    threadpool->speculation = 0;
+    threadpool->speculated_cnt = 0;
+    threadpool->duration_total = 0;
+    threadpool->duration_cnt = 0;
+    threadpool->default_pool = MS_CreatePool("default", POOL_FIFO, 1, 0);
 
     // Compute number of CPUs and initialize threads
     cpu_set_t set;
@@ -251,10 +581,20 @@ void MS_Run()
     }
     int numcpus = CPU_COUNT(&set);
     threadpool->numthreads = numcpus;
+
+    // Executors are forked before any thread exists. Every worker thread drives one of them
+    threadpool->executors = NULL;
+    threadpool->executors_cnt = 0;
+    if (executors > 0)
+    {
+        cluster_init(executors);
+        threadpool->numthreads = executors;
+    }
     threadpool->threads = malloc(sizeof(pthread_t) * threadpool->numthreads);
     for (int i = 0; i < threadpool->numthreads; i++)
     {
-        if ((pthread_create(&threadpool->threads[i], NULL, worker_func, NULL)) != 0)
+        Executor *executor = executors > 0 ? &threadpool->executors[i] : NULL;
+        if ((pthread_create(&threadpool->threads[i], NULL, worker_func, executor)) != 0)
         {
             perror("Thread creation failure");
             exit(1);
@@ -277,7 +617,6 @@ void MS_TearDown()
     pthread_mutex_unlock(&threadpool->queue_mutex);
     pthread_mutex_unlock(&threadpool->monitor_mutex);
 
-    pthread_cond_broadcast(&threadpool->work_start);
     pthread_cond_broadcast(&threadpool->new_work);
     pthread_cond_signal(&threadpool->new_monitor);
 
@@ -291,15 +630,71 @@ void MS_TearDown()
     pthread_mutex_destroy(&threadpool->work_mutex);
     pthread_mutex_destroy(&threadpool->monitor_mutex);
 
-    pthread_cond_destroy(&threadpool->work_start);
     pthread_cond_destroy(&threadpool->work_ready);
     pthread_cond_destroy(&threadpool->new_work);
     pthread_cond_destroy(&threadpool->new_monitor);
 
+    // Destroy the scheduling pools
+    ListIter iter = list_get_iter(threadpool->pools);
+    SchedPool *pool;
+    while ((pool = iter_next(&iter)) != NULL)
+    {
+      free(pool->name);
+      list_free(pool->jobs);
+    }
+    list_free(threadpool->pools);
+    shuffle_destroy();
+    memory_destroy();
+    if (threadpool->executors_cnt > 0)
+        cluster_destroy();
+
     // Close the log file
     fclose(fn);
 }
 
+void MS_SetSchedulingMode(SchedMode mode)
+{
+  pthread_mutex_lock(&threadpool->queue_mutex);
+  threadpool->mode = mode;
+  pthread_mutex_unlock(&threadpool->queue_mutex);
+}
+
+SchedPool* MS_CreatePool(char *name, SchedMode mode, int weight, int priority)
+{
+  SchedPool *pool = malloc(sizeof(SchedPool));
+  pool->name = strdup(name);
+  pool->mode = mode;
+  pool->weight = weight > 0 ? weight : 1;
+  pool->priority = priority;
+  pool->running = 0;
+  pool->jobs = list_init();
+
+  pthread_mutex_lock(&threadpool->queue_mutex);
+  list_add(threadpool->pools, pool);
+  pthread_mutex_unlock(&threadpool->queue_mutex);
+  return pool;
+}
+
+void MS_SetPool(SchedPool *pool)
+{
+  current_pool = pool;
+}
+
+void MS_SetSpeculation(double multiplier)
+{
+  pthread_mutex_lock(&threadpool->queue_mutex);
+  threadpool->speculation = multiplier;
+  pthread_mutex_unlock(&threadpool->queue_mutex);
+}
+
+int MS_SpeculatedCount()
+{
+  pthread_mutex_lock(&threadpool->queue_mutex);
+  int cnt = threadpool->speculated_cnt;
+  pthread_mutex_unlock(&threadpool->queue_mutex);
+  return cnt;
+}
+
 void monitor_func(void *arg)
 {
   (void *)arg;
@@ -312,32 +707,134 @@ void monitor_func(void *arg)
       pthread_cond_wait(&threadpool->new_monitor, &threadpool->monitor_mutex);
     pthread_mutex_unlock(&threadpool->monitor_mutex);
 
-    // Check if shutdown signal was sent
-    if (threadpool->shutdown)
+    // Check if shutdown signal was sent and everything was logged
+    if (monitor_val == NULL)
       return;
 
     // Do work
     print_formatted_metric(monitor_val, fn);
+    if (monitor_val->job != NULL)
+    {
+      print_formatted_job_metric(monitor_val->job, fn);
+      free(monitor_val->job);
+    }
+    free(monitor_val);
   }
 }
 
+/* Re-ranks all active jobs, called when a stage gets its first observed duration */
+void rank_jobs()
+{
+  ListIter pools = list_get_iter(threadpool->pools);
+  SchedPool *pool;
+  while ((pool = iter_next(&pools)) != NULL)
+  {
+    ListIter jobs = list_get_iter(pool->jobs);
+    Job *job;
+    while ((job = iter_next(&jobs)) != NULL)
+      rank_job(job);
+  }
+}
+
+/* Called with queue_mutex held once a task is done. Returns the job summary if
+ * this was the last task of its job */
+JobMetric *finish_task(Task *task)
+{
+  // Record the observed duration for critical path estimates
+  RDD *rdd = task->rdd;
+  rdd->duration_total += task->metric->duration;
+  rdd->duration_cnt += 1;
+  threadpool->duration_total += task->metric->duration;
+  threadpool->duration_cnt += 1;
+  if (rdd->durations_cnt < rdd->partitions_cnt)
+    rdd->durations[rdd->durations_cnt++] = task->metric->duration;
+  if (rdd->duration_cnt == 1)
+    rank_jobs();
+
+  Job *job = task->job;
+  list_remove(job->active, task);
+  if (task->twin != NULL)
+    task->twin->twin = NULL;
+  job->running -= 1;
+  job->pool->running -= 1;
+  job->pending -= 1;
+  if (job->pending > 0)
+    return NULL;
+
+  list_remove(job->pool->jobs, job);
+
+  struct timespec time_finished;
+  clock_gettime(CLOCK_MONOTONIC, &time_finished);
+  JobMetric *metric = malloc(sizeof(JobMetric));
+  metric->jobid = job->id;
+  metric->pool = job->pool->name;
+  metric->tasks = job->tasks_cnt;
+  metric->submitted = job->submitted;
+  metric->wait_avg = job->wait_total / job->tasks_cnt;
+  metric->wait_max = job->wait_max;
+  metric->duration = TIME_DIFF_MICROS(job->submitted, time_finished);
+  return metric;
+}
+
+/* Called with queue_mutex held for a speculative copy (or the original) whose output was
+ * discarded. Returns true if the job was left by its driver and can now be freed */
+bool drop_task(Task *task)
+{
+    Job *job = task->job;
+    list_remove(job->active, task);
+    if (task->twin != NULL)
+        task->twin->twin = NULL;
+    job->running -= 1;
+    job->pool->running -= 1;
+    return job->detached && job->active->num_items == 0;
+}
+
+/* Puts a failed task back into its job queue, giving up after MAX_TASK_ATTEMPTS */
+void retry_task(Task *task)
+{
+    task->attempts += 1;
+    if (task->attempts >= MAX_TASK_ATTEMPTS)
+    {
+        printf("task for partition %d of RDD %p failed %d times\n", task->pnum, (void *)task->rdd, task->attempts);
+        exit(1);
+    }
+
+    pthread_mutex_lock(&threadpool->queue_mutex);
+    list_remove(task->job->active, task);
+    task->job->running -= 1;
+    task->job->pool->running -= 1;
+    clock_gettime(CLOCK_MONOTONIC, &task->metric->created);
+    queue_push(task->job->queue, task);
+    pthread_mutex_unlock(&threadpool->queue_mutex);
+    pthread_cond_broadcast(&threadpool->new_work);
+}
+
 void worker_func(void *arg)
 {
-    (void *)arg;
+    current_executor = arg;
     // Work processing loop
     while (1)
     {
-        // Check if there is work to do
-        pthread_mutex_lock(&threadpool->work_mutex);
-        while (!threadpool->started && !threadpool->shutdown)
-            pthread_cond_wait(&threadpool->work_start, &threadpool->work_mutex);
-        pthread_mutex_unlock(&threadpool->work_mutex);
-
-        // Fetch the task
+        // Fetch the next ready task, waiting until some other task finishes if there is none.
+        // With speculation on, idle workers wake up periodically to look for stragglers
         Task *task;
         pthread_mutex_lock(&threadpool->queue_mutex);
-        while ((task = queue_pop(threadpool->queue)) == NULL && !threadpool->shutdown)
-          pthread_cond_wait(&threadpool->new_work, &threadpool->queue_mutex);
+        while ((task = schedule_task()) == NULL && (task = speculate_task()) == NULL && !threadpool->shutdown)
+        {
+          if (threadpool->speculation > 0)
+          {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += SPECULATION_INTERVAL_MS * 1000000L;
+            deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+            deadline.tv_nsec %= 1000000000L;
+            pthread_cond_timedwait(&threadpool->new_work, &threadpool->queue_mutex, &deadline);
+          }
+          else
+          {
+            pthread_cond_wait(&threadpool->new_work, &threadpool->queue_mutex);
+          }
+        }
         pthread_mutex_unlock(&threadpool->queue_mutex);
 
         if (threadpool->shutdown)
@@ -345,45 +842,241 @@ void worker_func(void *arg)
           return;
         }
 
-        // Return task back to the queue if dependencies haven't been resolved
-        if (!validate_task(task))
+        // Work on materializing the task and recording the time. Failed copies are dropped
+        // as the original is still running
+        bool resolved = resolve_task(task);
+        if (!resolved && !task->speculative)
         {
-            pthread_mutex_lock(&threadpool->queue_mutex);
-            queue_push(threadpool->queue, task);
-            pthread_mutex_unlock(&threadpool->queue_mutex);
-            pthread_cond_signal(&threadpool->new_work);
+            retry_task(task);
             continue;
         }
-
-        // Work on materializing the task and recording the time
-        clock_gettime(CLOCK_MONOTONIC, &task->metric->scheduled);
-        resolve_task(task);
         struct timespec time_finished;
         clock_gettime(CLOCK_MONOTONIC, &time_finished);
         task->metric->duration = TIME_DIFF_MICROS(task->metric->scheduled, time_finished);
 
+        // The copy which lost the race only gets its metric logged
+        if (!resolved || task->discarded)
+        {
+            pthread_mutex_lock(&threadpool->queue_mutex);
+            bool orphaned = drop_task(task);
+            pthread_mutex_unlock(&threadpool->queue_mutex);
+            if (orphaned)
+                job_free(task->job);
+            task->metric->job = NULL;
+            pthread_mutex_lock(&threadpool->monitor_mutex);
+            queue_push(threadpool->monitor_queue, (Task *)task->metric);
+            pthread_mutex_unlock(&threadpool->monitor_mutex);
+            pthread_cond_signal(&threadpool->new_monitor);
+            free(task);
+            continue;
+        }
+
+        // Update the job and wake up workers whose tasks may have become ready
+        pthread_mutex_lock(&threadpool->queue_mutex);
+        task->metric->job = finish_task(task);
+        pthread_mutex_unlock(&threadpool->queue_mutex);
+        pthread_cond_broadcast(&threadpool->new_work);
+
         // Send this metric to the metric pool
+        bool tostop = task->metric->job != NULL;
         pthread_mutex_lock(&threadpool->monitor_mutex);
         queue_push(threadpool->monitor_queue, (Task *)task->metric);
         pthread_mutex_unlock(&threadpool->monitor_mutex);
         pthread_cond_signal(&threadpool->new_monitor);
 
-        // Decide if we need to stop working
-        RDD *rdd = task->rdd;
-        bool tostop = false;
-        pthread_mutex_lock(&task->rdd->lock);
-        tostop = task->finalrdd && rdd->materialized_cnt == rdd->partitions_cnt;
-        pthread_mutex_unlock(&task->rdd->lock);
-
-        // TODO: Destroy task metadata
+        // Wake up the driver if its job is complete, and drivers which wait for partitions
+        // of other jobs whenever one is done
+        pthread_mutex_lock(&threadpool->work_mutex);
         if (tostop)
+            task->job->done = true;
+        bool wake = tostop || threadpool->awaiting > 0;
+        pthread_mutex_unlock(&threadpool->work_mutex);
+        if (wake)
+            pthread_cond_broadcast(&threadpool->work_ready);
+        free(task);
+    }
+}
+
+/* Pool and job orderings used by schedule_task */
+int compare_pools_fair(const void *a, const void *b)
+{
+  SchedPool *p1 = *(SchedPool **)a;
+  SchedPool *p2 = *(SchedPool **)b;
+  if (p1->priority != p2->priority)
+    return p2->priority - p1->priority;
+
+  // Pool which received the smallest share relative to its weight goes first
+  long share1 = (long)p1->running * p2->weight;
+  long share2 = (long)p2->running * p1->weight;
+  if (share1 != share2)
+    return share1 < share2 ? -1 : 1;
+  return p2->weight - p1->weight;
+}
+
+int compare_jobs_fifo(const void *a, const void *b)
+{
+  Job *j1 = *(Job **)a;
+  Job *j2 = *(Job **)b;
+  if (j1->pool->priority != j2->pool->priority)
+    return j2->pool->priority - j1->pool->priority;
+  return j1->id - j2->id;
+}
+
+int compare_jobs_fair(const void *a, const void *b)
+{
+  Job *j1 = *(Job **)a;
+  Job *j2 = *(Job **)b;
+  if (j1->running != j2->running)
+    return j1->running - j2->running;
+  return j1->id - j2->id;
+}
+
+/* Collects jobs of the given pools and orders them, returns the number of jobs */
+int collect_jobs(SchedPool **pools, int npools, Job **jobs, int (*compare)(const void *, const void *))
+{
+  int njobs = 0;
+  for (int i = 0; i < npools; i++)
+  {
+    ListIter iter = list_get_iter(pools[i]->jobs);
+    Job *job;
+    while ((job = iter_next(&iter)) != NULL)
+      jobs[njobs++] = job;
+  }
+  qsort(jobs, njobs, sizeof(Job *), compare);
+  return njobs;
+}
+
+/* Accounts for a task handed to a worker */
+void start_task(Task *task)
+{
+  Job *job = task->job;
+  job->running += 1;
+  job->pool->running += 1;
+  list_add(job->active, task);
+
+  clock_gettime(CLOCK_MONOTONIC, &task->metric->scheduled);
+  size_t wait = TIME_DIFF_MICROS(task->metric->created, task->metric->scheduled);
+  job->tasks_cnt += 1;
+  job->wait_total += wait;
+  if (wait > job->wait_max)
+    job->wait_max = wait;
+}
+
+/* Hands out the first ready task of the given jobs, in order */
+Task *dispatch_task(Job **jobs, int njobs)
+{
+  for (int i = 0; i < njobs; i++)
+  {
+    Task *task = queue_pop_ready(jobs[i]->queue);
+    if (task == NULL)
+      continue;
+    start_task(task);
+    return task;
+  }
+  return NULL;
+}
+
+int compare_durations(const void *a, const void *b)
+{
+  size_t d1 = *(size_t *)a;
+  size_t d2 = *(size_t *)b;
+  return d1 < d2 ? -1 : d1 > d2;
+}
+
+/* Median duration of the stage's finished tasks, 0 if too few of them are done */
+size_t stage_median(RDD *rdd)
+{
+  int cnt = rdd->durations_cnt;
+  if (cnt == 0 || cnt < rdd->partitions_cnt * SPECULATION_QUANTILE)
+    return 0;
+  size_t sorted[cnt];
+  memcpy(sorted, rdd->durations, sizeof(size_t) * cnt);
+  qsort(sorted, cnt, sizeof(size_t), compare_durations);
+  return sorted[cnt / 2];
+}
+
+Task* speculate_task()
+{
+  if (threadpool->speculation <= 0)
+    return NULL;
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  // Pick the task which overran its stage median by the largest factor
+  Task *straggler = NULL;
+  double worst = threadpool->speculation;
+  ListIter pools = list_get_iter(threadpool->pools);
+  SchedPool *pool;
+  while ((pool = iter_next(&pools)) != NULL)
+  {
+    ListIter jobs = list_get_iter(pool->jobs);
+    Job *job;
+    while ((job = iter_next(&jobs)) != NULL)
+    {
+      ListIter active = list_get_iter(job->active);
+      Task *task;
+      while ((task = iter_next(&active)) != NULL)
+      {
+        if (task->speculative || task->twin != NULL)
+          continue;
+        size_t median = stage_median(task->rdd);
+        if (median == 0)
+          continue;
+        double overrun = (double)TIME_DIFF_MICROS(task->metric->scheduled, now) / median;
+        if (overrun > worst)
         {
-            pthread_mutex_lock(&threadpool->work_mutex);
-            threadpool->started = false;
-            pthread_mutex_unlock(&threadpool->work_mutex);
-            pthread_cond_signal(&threadpool->work_ready);
+          worst = overrun;
+          straggler = task;
         }
+      }
     }
+  }
+  if (straggler == NULL)
+    return NULL;
+
+  Task *copy = create_task(straggler->rdd, straggler->pnum, straggler->finalrdd, straggler->job);
+  copy->speculative = true;
+  copy->twin = straggler;
+  straggler->twin = copy;
+  start_task(copy);
+  threadpool->speculated_cnt += 1;
+  return copy;
+}
+
+Task* schedule_task()
+{
+  int npools = threadpool->pools->num_items;
+  int njobs = 0;
+  SchedPool *pools[npools];
+  ListIter iter = list_get_iter(threadpool->pools);
+  for (int i = 0; i < npools; i++)
+  {
+    pools[i] = iter_next(&iter);
+    njobs += pools[i]->jobs->num_items;
+  }
+  if (njobs == 0)
+    return NULL;
+  Job *jobs[njobs];
+
+  // FIFO: every job is ordered by its pool priority and then by submission order
+  if (threadpool->mode == POOL_FIFO)
+  {
+    njobs = collect_jobs(pools, npools, jobs, compare_jobs_fifo);
+    return dispatch_task(jobs, njobs);
+  }
+
+  // FAIR: serve the most underserved pool first, ordering its jobs by the pool policy
+  qsort(pools, npools, sizeof(SchedPool *), compare_pools_fair);
+  for (int i = 0; i < npools; i++)
+  {
+    njobs = collect_jobs(&pools[i], 1, jobs,
+                         pools[i]->mode == POOL_FAIR ? compare_jobs_fair : compare_jobs_fifo);
+    Task *task = dispatch_task(jobs, njobs);
+    if (task != NULL)
+      return task;
+  }
+  return NULL;
 }
 
 bool validate_task(Task *task)
@@ -391,7 +1084,18 @@ bool validate_task(Task *task)
     // Check the type of RDD
     RDD *rdd = task->rdd;
     bool result = false;
-    if (rdd->trans == MAP || rdd->trans == FILTER)
+    for (int i = 0; i < rdd->dependencies_cnt; i++)
+    {
+        if (rdd->dependencies[i]->trans == UNION)
+            union_sync(rdd->dependencies[i]);
+    }
+    if (rdd->fused)
+    {
+        // Recomputes its input from lineage
+        result = true;
+    }
+    else if (rdd->trans == MAP || rdd->trans == FILTER || rdd->trans == SAMPLE || rdd->trans == TOPK ||
+        rdd->trans == DISTINCT || rdd->trans == FLATMAP || rdd->trans == MAPPARTITIONS)
     {
         // Check only corresponding partition
         RDD *dependancy = rdd->dependencies[0];
@@ -399,7 +1103,7 @@ bool validate_task(Task *task)
         result = dependancy->partitions[task->pnum] != NULL;
         pthread_mutex_unlock(&dependancy->lock);
     }
-    else if (rdd->trans == PARTITIONBY)
+    else if (rdd->trans == PARTITIONBY || rdd->trans == COALESCE)
     {   
         // Check if entire dependency is materialized
         RDD *dependancy = rdd->dependencies[0];
@@ -407,7 +1111,35 @@ bool validate_task(Task *task)
         result = dependancy->materialized_cnt == dependancy->partitions_cnt;
         pthread_mutex_unlock(&dependancy->lock);
     }
-    else if (rdd->trans == JOIN)
+    else if (rdd->trans == BROADCAST)
+    {
+        // The partition of the big side and all of the small side
+        RDD *big = rdd->dependencies[0];
+        pthread_mutex_lock(&big->lock);
+        bool temp = big->partitions[task->pnum] != NULL;
+        pthread_mutex_unlock(&big->lock);
+        if (!temp)
+            return false;
+
+        RDD *small = rdd->dependencies[1];
+        pthread_mutex_lock(&small->lock);
+        result = small->materialized_cnt == small->partitions_cnt;
+        pthread_mutex_unlock(&small->lock);
+    }
+    else if (rdd->trans == JOIN && co_partitioned(rdd))
+    {
+        // Only the corresponding partition of both sides, which a skewed join may share
+        int ppnum = rdd->skew != NULL ? rdd->skew->partition[task->pnum] : task->pnum;
+        result = true;
+        for (int i = 0; i < 2 && result; i++)
+        {
+            RDD *dependancy = rdd->dependencies[i];
+            pthread_mutex_lock(&dependancy->lock);
+            result = dependancy->partitions[ppnum] != NULL;
+            pthread_mutex_unlock(&dependancy->lock);
+        }
+    }
+    else if (rdd->trans == JOIN || rdd->trans == SORT)
     {
         // Check if both dependencies are materialized
         RDD *dependency1 = rdd->dependencies[0];
@@ -431,19 +1163,98 @@ bool validate_task(Task *task)
     return result;
 }
 
-void resolve_task(Task *task)
+List *open_input(RDD *dep, int pnum, bool fresh)
 {
-    RDD *rdd = task->rdd;
+    // Files are opened for every read so that they can be read again
+    if (dep->trans == FILE_BACKED)
+    {
+        FILE *fp = fopen(list_get(dep->partitions[pnum], 0), "r");
+        if (fp == NULL)
+            return NULL;
+        List *input = list_init();
+        list_add(input, fp);
+        return input;
+    }
+
+    if (fresh)
+        return compute_partition(dep, pnum, true, NULL);
+
+    List *input = dep->partitions[pnum];
+    list_pin(input);
+    return input;
+}
+
+void close_input(RDD *dep, List *input, bool fresh)
+{
+    if (dep->trans == FILE_BACKED)
+    {
+        fclose(list_get(input, 0));
+        list_node_free(input);
+    }
+    else if (fresh)
+    {
+        // The items were handed over to the transformation
+        list_node_free(input);
+    }
+    else
+    {
+        list_unpin(input);
+    }
+}
+
+/* Lets only the first copy of a task keep its output, so that the inputs are consumed once */
+bool claim_partition(RDD *rdd, int pnum)
+{
+    pthread_mutex_lock(&rdd->lock);
+    bool first = !rdd->claimed[pnum];
+    rdd->claimed[pnum] = true;
+    pthread_mutex_unlock(&rdd->lock);
+    return first;
+}
+
+/* Throws away the output of an original which lost the race. Its inputs were consumed
+ * like the winner's would have been, so the items it selected or produced are freed */
+List *discard_partition(RDD *rdd, List *list, bool *discarded)
+{
+    if (list->slices != NULL)
+    {
+        list_pin(list);
+        ListIter iter = list_get_iter(list);
+        void *data;
+        while ((data = iter_next(&iter)) != NULL)
+            free_item(rdd, data);
+        list_consume(list);
+        list_unpin(list);
+    }
+    list_free_items(list, rdd);
+    *discarded = true;
+    return NULL;
+}
+
+/* The Emitter handed to flatMap functions */
+void emit_item(void *out, void *item)
+{
+    list_add(out, item);
+}
+
+List *compute_partition(RDD *rdd, int pnum, bool fresh, bool *discarded)
+{
+    if (discarded != NULL)
+        *discarded = false;
     switch (rdd->trans)
     {
         case MAP:
         {
             RDD *dependancy = rdd->dependencies[0];
-            int pnum = task->pnum;
             List *newpartition = list_init();
 
             // Start iterating
-            List *oldpartition = dependancy->partitions[pnum];
+            List *oldpartition = open_input(dependancy, pnum, fresh);
+            if (oldpartition == NULL)
+            {
+                list_free(newpartition);
+                return NULL;
+            }
             ListIter iter = list_get_iter(oldpartition);
             void *data;
             while ((data = iter_next(&iter)) != NULL)
@@ -460,72 +1271,145 @@ void resolve_task(Task *task)
                     list_add(newpartition, transformed_data);
                 }
             }
+            bool keep = fresh || claim_partition(rdd, pnum);
+            if (!fresh)
+                list_consume(oldpartition);
+            close_input(dependancy, oldpartition, fresh);
+            return keep ? newpartition : discard_partition(rdd, newpartition, discarded);
+        }
+        case FLATMAP:
+        case MAPPARTITIONS:
+        {
+            RDD *dependancy = rdd->dependencies[0];
+            List *newpartition = list_init();
+            List *oldpartition = open_input(dependancy, pnum, fresh);
+            if (oldpartition == NULL)
+            {
+                list_free(newpartition);
+                return NULL;
+            }
 
-            pthread_mutex_lock(&rdd->lock);
-            rdd->partitions[pnum] = newpartition;
-            rdd->materialized_cnt += 1;
-            pthread_mutex_unlock(&rdd->lock);
-            break;
+            // Whatever fn emits goes straight into the new partition. mapPartitions
+            // hands over the whole input at once
+            ListIter iter = list_get_iter(oldpartition);
+            if (rdd->trans == MAPPARTITIONS)
+            {
+                ((PartitionFn)rdd->fn)(&iter, emit_item, newpartition, rdd->ctx);
+            }
+            else
+            {
+                void *data;
+                while ((data = iter_next(&iter)) != NULL)
+                    ((FlatMapper)rdd->fn)(data, emit_item, newpartition, rdd->ctx);
+            }
+            bool keep = fresh || claim_partition(rdd, pnum);
+            if (!fresh)
+                list_consume(oldpartition);
+            close_input(dependancy, oldpartition, fresh);
+            return keep ? newpartition : discard_partition(rdd, newpartition, discarded);
         }
         case FILTER:
         {
             RDD *dependancy = rdd->dependencies[0];
-            int pnum = task->pnum;
-            List *newpartition = list_init();
+            List *oldpartition = open_input(dependancy, pnum, fresh);
+            if (oldpartition == NULL)
+                return NULL;
+
+            // Recomputed items are copied, otherwise the new partition is a view
+            // selecting the surviving items of the old one
+            List *newpartition = fresh ? list_init() : list_view_init();
+            if (!fresh)
+                list_view_add(newpartition, oldpartition);
 
-            // Start iterating
-            List *oldpartition = dependancy->partitions[pnum];
             ListIter iter = list_get_iter(oldpartition);
             void *data;
             while ((data = iter_next(&iter)) != NULL)
             {
-                if (((Filter)rdd->fn)(data, rdd->ctx))
+                if (!((Filter)rdd->fn)(data, rdd->ctx))
+                    continue;
+                if (fresh)
                     list_add(newpartition, data);
+                else
+                    list_view_select(newpartition, iter.slice, iter.index - 1);
             }
 
-            pthread_mutex_lock(&rdd->lock);
-            rdd->partitions[pnum] = newpartition;
-            rdd->materialized_cnt += 1;
-            pthread_mutex_unlock(&rdd->lock);
-            break;
+            // Rejected items are handed to the filter, the surviving ones stay in their blocks
+            bool keep = fresh || claim_partition(rdd, pnum);
+            if (!fresh)
+            {
+                list_consume_except(oldpartition, newpartition);
+                list_view_finish(newpartition);
+            }
+            close_input(dependancy, oldpartition, fresh);
+            return keep ? newpartition : discard_partition(rdd, newpartition, discarded);
         }
         case PARTITIONBY:
         {
             RDD *dependency = rdd->dependencies[0];
-            int pnum = task->pnum;
-            List *newpartition = list_init();
+            if (!fresh && shuffle_eligible(rdd))
+            {
+              // Shuffled items are copies, so the losing copy of a task frees them
+              List *newpartition = shuffle_read(rdd, pnum);
+              if (claim_partition(rdd, pnum))
+                return newpartition;
+              list_free_items(newpartition, rdd);
+              *discarded = true;
+              return NULL;
+            }
 
-            // Iterate through entire dependency
+            List *newpartition = fresh ? list_init() : list_view_init();
+
+            // Iterate through entire dependency, selecting the items which belong to pnum
             for (int i = 0; i < dependency->partitions_cnt; i++)
             {
-              List *oldpartition = dependency->partitions[i];
+              List *oldpartition = open_input(dependency, i, fresh);
+              if (oldpartition == NULL)
+              {
+                list_free_items(newpartition, rdd);
+                return NULL;
+              }
+              int slice = fresh ? 0 : list_view_add(newpartition, oldpartition);
               ListIter iter = list_get_iter(oldpartition);
               void *data;
               while ((data = iter_next(&iter)) != NULL)
               {
-                if (((Partitioner)rdd->fn)(data, rdd->partitions_cnt, rdd->ctx) == pnum)
-                  list_add(newpartition, data);
+                if (partition_of(rdd, data) == pnum)
+                {
+                  if (fresh)
+                    list_add(newpartition, data);
+                  else
+                    list_view_select(newpartition, slice + iter.slice, iter.index - 1);
+                }
+                else if (fresh && dependency->trans != FILE_BACKED)
+                {
+                  free_item(dependency, data); // recomputed copy which belongs to another partition
+                }
               }
+              close_input(dependency, oldpartition, fresh);
             }
-
-            // Assign new partition to RDD
-            pthread_mutex_lock(&rdd->lock);
-            rdd->partitions[pnum] = newpartition;
-            rdd->materialized_cnt += 1;
-            pthread_mutex_unlock(&rdd->lock);
-            break;
+            if (!fresh)
+              list_view_finish(newpartition);
+            bool keep = fresh || claim_partition(rdd, pnum);
+            return keep ? newpartition : discard_partition(rdd, newpartition, discarded);
         }
         case JOIN:
         {
-            // Be careful by creating partition and once it finishes assign it to RDD
-            RDD *dependancy1 = rdd->dependencies[0];
-            RDD *dependancy2 = rdd->dependencies[1];
-            int pnum = task->pnum;
-            List *newpartition = list_init();
+            if (rdd->key != NULL)
+              return hash_join(rdd, pnum, fresh, discarded);
 
+            // Be careful by creating partition and once it finishes assign it to RDD
             // Start iterating
-            List *oldpartition1 = dependancy1->partitions[pnum];
-            List *oldpartition2 = dependancy2->partitions[pnum];
+            List *input1, *input2;
+            List *oldpartition1 = join_open(rdd, 0, pnum, fresh, &input1);
+            if (oldpartition1 == NULL)
+              return NULL;
+            List *oldpartition2 = join_open(rdd, 1, pnum, fresh, &input2);
+            if (oldpartition2 == NULL)
+            {
+              join_close(rdd, 0, fresh, oldpartition1, input1);
+              return NULL;
+            }
+            List *newpartition = list_init();
             
             ListIter iter1 = list_get_iter(oldpartition1);
             void *data1;
@@ -540,19 +1424,108 @@ void resolve_task(Task *task)
                   list_add(newpartition, newelem);
               }
             }
-
-            // Assign new partition to RDD
-            pthread_mutex_lock(&rdd->lock);
-            rdd->partitions[pnum] = newpartition;
-            rdd->materialized_cnt += 1;
-            pthread_mutex_unlock(&rdd->lock);
-            break;
+            bool keep = fresh || claim_partition(rdd, pnum);
+            if (!fresh)
+            {
+              join_consume(rdd, 0, pnum, oldpartition1);
+              join_consume(rdd, 1, pnum, oldpartition2);
+            }
+            join_close(rdd, 0, fresh, oldpartition1, input1);
+            join_close(rdd, 1, fresh, oldpartition2, input2);
+            return keep ? newpartition : discard_partition(rdd, newpartition, discarded);
+        }
+        case BROADCAST:
+        {
+          return broadcast_join(rdd, pnum, fresh, discarded);
+        }
+        case SAMPLE:
+        {
+          return sample_partition(rdd, pnum, fresh, discarded);
+        }
+        case SORT:
+        {
+          return sort_partition(rdd, pnum, fresh, discarded);
+        }
+        case TOPK:
+        {
+          return topk_partition(rdd, pnum, fresh, discarded);
+        }
+        case DISTINCT:
+        {
+          return distinct_partition(rdd, pnum, fresh, discarded);
+        }
+        case COALESCE:
+        {
+          return coalesce_partition(rdd, pnum, fresh, discarded);
+        }
+        case UNION:
+        {
+          // Unions run no tasks, a lost partition is recomputed by the parent it belongs to
+          for (int i = 0; i < rdd->dependencies_cnt; i++)
+          {
+            RDD *dependency = rdd->dependencies[i];
+            if (pnum < dependency->partitions_cnt)
+              return compute_partition(dependency, pnum, fresh, discarded);
+            pnum -= dependency->partitions_cnt;
+          }
+          return NULL;
         }
         case FILE_BACKED:
         {
-          return;
+          return NULL;
         }
     }
+    return NULL;
+}
+
+bool resolve_task(Task *task)
+{
+    RDD *rdd = task->rdd;
+    int pnum = task->pnum;
+
+    // Inputs are only consumed once the whole partition was computed, so a failed attempt
+    // leaves them untouched for the retry
+    List *newpartition;
+    if (current_executor != NULL && remote_eligible(rdd))
+    {
+        // Remote results are copies, so the inputs are left to their blocks
+        task->discarded = false;
+        newpartition = remote_compute(current_executor, rdd, pnum);
+        if (newpartition != NULL && !claim_partition(rdd, pnum))
+        {
+            list_free_items(newpartition, rdd);
+            task->discarded = true;
+        }
+    }
+    else if (task->speculative)
+    {
+        // User functions may take over their inputs, so a copy must not share them with the
+        // original. It recomputes its own from lineage instead
+        task->discarded = false;
+        newpartition = compute_partition(rdd, pnum, true, NULL);
+        if (newpartition != NULL && !claim_partition(rdd, pnum))
+        {
+            list_free_items(newpartition, rdd);
+            task->discarded = true;
+        }
+    }
+    else
+    {
+        newpartition = compute_partition(rdd, pnum, false, &task->discarded);
+    }
+    if (task->discarded)
+        return true;
+    if (newpartition == NULL)
+        return false;
+    task->metric->items = newpartition->num_items;
+    block_register(newpartition, rdd, pnum);
+
+    // Assign new partition to RDD
+    pthread_mutex_lock(&rdd->lock);
+    rdd->partitions[pnum] = newpartition;
+    rdd->materialized_cnt += 1;
+    pthread_mutex_unlock(&rdd->lock);
+    return true;
 }
 
 List* list_init()
@@ -561,9 +1534,87 @@ List* list_init()
     result->num_items = 0;
     result->head = NULL;
     result->tail = NULL;
+    result->slices = NULL;
+    result->slices_cnt = 0;
+    result->block = NULL;
+    return result;
+}
+
+List* list_view_init()
+{
+    List *result = list_init();
+    result->slices = malloc(sizeof(ListSlice));
     return result;
 }
 
+int list_view_add(List *view, List *list)
+{
+    int first = view->slices_cnt;
+    int added = list->slices != NULL ? list->slices_cnt : 1;
+    view->slices = realloc(view->slices, sizeof(ListSlice) * (first + added + 1));
+
+    for (int i = 0; i < added; i++)
+    {
+        ListSlice *slice = &view->slices[first + i];
+        slice->base = list->slices != NULL ? list->slices[i].base : list;
+        slice->bitmap = calloc((slice->base->num_items + 7) / 8, 1);
+        slice->selected = 0;
+    }
+    view->slices_cnt += added;
+    return first;
+}
+
+void list_view_select(List *view, int slice, int indx)
+{
+    ListSlice *s = &view->slices[slice];
+    s->bitmap[indx / 8] |= 1 << (indx % 8);
+    s->selected += 1;
+    view->num_items += 1;
+}
+
+void list_view_finish(List *view)
+{
+    int kept = 0;
+    for (int i = 0; i < view->slices_cnt; i++)
+    {
+        ListSlice slice = view->slices[i];
+        if (slice.selected == 0)
+        {
+            free(slice.bitmap);
+            continue;
+        }
+        if (slice.selected == slice.base->num_items)
+        {
+            free(slice.bitmap);
+            slice.bitmap = NULL;
+        }
+        view->slices[kept++] = slice;
+    }
+    view->slices_cnt = kept;
+}
+
+void list_view_add_all(List *view, List *list)
+{
+    int first = list_view_add(view, list);
+    for (int i = first; i < view->slices_cnt; i++)
+    {
+        ListSlice *slice = &view->slices[i];
+        ListSlice *source = list->slices != NULL ? &list->slices[i - first] : NULL;
+        if (source != NULL && source->bitmap != NULL)
+        {
+            memcpy(slice->bitmap, source->bitmap, (slice->base->num_items + 7) / 8);
+            slice->selected = source->selected;
+        }
+        else
+        {
+            // Everything is selected, list_view_finish drops the bitmap
+            memset(slice->bitmap, 0xff, (slice->base->num_items + 7) / 8);
+            slice->selected = slice->base->num_items;
+        }
+    }
+    view->num_items += list->num_items;
+}
+
 bool list_add(List *list, void *data)
 {
     if (list == NULL || data == NULL)
@@ -597,12 +1648,12 @@ void* list_get(List *list, int indx)
     if (indx < 0 || indx >= list->num_items)
         return NULL;
     
-    ListNode *temp = list->head;
+    ListIter iter = list_get_iter(list);
     for (int i = 0; i < indx; i++)
     {
-        temp = temp->next;
+        iter_next(&iter);
     }
-    return temp->data;
+    return iter_next(&iter);
 }
 
 void list_free(List *list)
@@ -610,6 +1661,15 @@ void list_free(List *list)
   if (list == NULL)
     return;
 
+  if (list->slices != NULL)
+  {
+    for (int i = 0; i < list->slices_cnt; i++)
+      free(list->slices[i].bitmap);
+    free(list->slices);
+    free(list);
+    return;
+  }
+
   ListNode *current = list->head;
   while (current)
   {
@@ -621,6 +1681,60 @@ void list_free(List *list)
   free(list);
 }
 
+void free_item(RDD *rdd, void *data)
+{
+  if (rdd->freer != NULL)
+    rdd->freer(data);
+  else
+    free(data);
+}
+
+void list_free_items(List *list, RDD *rdd)
+{
+  if (list == NULL || list->slices != NULL)
+  {
+    list_free(list);
+    return;
+  }
+
+  ListNode *current = list->head;
+  while (current)
+  {
+    ListNode *temp = current;
+    current = current->next;
+    if (temp->data != NULL)
+      free_item(rdd, temp->data);
+    free(temp);
+  }
+  free(list);
+}
+
+bool list_remove(List *list, void *data)
+{
+  if (list == NULL)
+    return false;
+
+  ListNode *prev = NULL;
+  ListNode *current = list->head;
+  while (current != NULL && current->data != data)
+  {
+    prev = current;
+    current = current->next;
+  }
+  if (current == NULL)
+    return false;
+
+  if (prev == NULL)
+    list->head = current->next;
+  else
+    prev->next = current->next;
+  if (list->tail == current)
+    list->tail = prev;
+  list->num_items -= 1;
+  free(current);
+  return true;
+}
+
 void list_node_free(List *list)
 {
   if (list == NULL)
@@ -639,19 +1753,55 @@ void list_node_free(List *list)
 ListIter list_get_iter(List *list)
 {
     ListIter iter;
-    iter.current = list->head;
+    iter.list = list;
+    iter.slice = 0;
+    iter.index = 0;
+    if (list->slices == NULL)
+        iter.current = list->head;
+    else
+        iter.current = list->slices_cnt > 0 ? list->slices[0].base->head : NULL;
     return iter;
 }
 
 
 void* iter_next(ListIter *iter)
 {
-    if (iter->current == NULL)
+    List *list = iter->list;
+    if (list->slices == NULL)
+    {
+        // Slots consumed while a block was spilled hold NULL and are skipped
+        while (iter->current != NULL)
+        {
+            void *result = iter->current->data;
+            iter->current = iter->current->next;
+            iter->index += 1;
+            if (result != NULL)
+                return result;
+        }
         return NULL;
+    }
 
-    void *result = iter->current->data;
-    iter->current = iter->current->next;
-    return result;
+    // Walk the base lists, skipping the items which are not selected
+    while (iter->slice < list->slices_cnt)
+    {
+        unsigned char *bitmap = list->slices[iter->slice].bitmap;
+        while (iter->current != NULL)
+        {
+            ListNode *node = iter->current;
+            int indx = iter->index;
+            iter->current = node->next;
+            iter->index += 1;
+            if (node->data != NULL && (bitmap == NULL || (bitmap[indx / 8] & (1 << (indx % 8)))))
+                return node->data;
+        }
+
+        if (iter->slice + 1 == list->slices_cnt)
+            break;
+        iter->slice += 1;
+        iter->current = list->slices[iter->slice].base->head;
+        iter->index = 0;
+    }
+    return NULL;
 }
 
 TaskQueue* queue_init()
@@ -704,3 +1854,41 @@ Task* queue_pop(TaskQueue *queue)
   free(node); // TODO: destroy data
   return result;
 }
+
+Task* queue_pop_ready(TaskQueue *queue)
+{
+  if (queue == NULL)
+    return NULL;
+
+  ListNode *node = NULL;
+  ListNode *prev = NULL;
+  long rank = 0;
+  for (ListNode *cur = queue->head, *curprev = NULL; cur != NULL; curprev = cur, cur = cur->next)
+  {
+    // Only validate tasks which would beat the current pick
+    Task *task = (Task *)cur->data;
+    if (node != NULL && task->rank <= rank)
+      continue;
+    if (validate_task(task))
+    {
+      node = cur;
+      prev = curprev;
+      rank = task->rank;
+    }
+  }
+  if (node == NULL)
+    return NULL;
+
+  // Unlink the ready task
+  if (prev == NULL)
+    queue->head = node->next;
+  else
+    prev->next = node->next;
+  if (queue->tail == node)
+    queue->tail = prev;
+
+  queue->num_tasks -= 1;
+  Task *result = (Task *)node->data;
+  free(node);
+  return result;
+}
@@ -5,6 +5,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
 #include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -12,25 +13,52 @@
 #include <assert.h>
 #include <unistd.h>
 #include <libgen.h>
+#include <sys/types.h>
 
 
-#define MAXDEPS (2)
+#define MAX_TASK_ATTEMPTS (4)
+#define SPECULATION_QUANTILE (0.5) // share of a stage that must be done before speculating
+#define SPECULATION_INTERVAL_MS (10) // how often idle workers look for stragglers
+#define SORT_SAMPLES (64) // keys sampled from every partition to pick sortBy's boundaries
+#define SORT_READ_BUFFER (64 * 1024) // read buffer of every run during an external merge
+#define ADAPTIVE_SPLIT (8) // buckets measured per hinted partition, the most it grows by
+#define SKEW_MAX_PIECES (16) // pieces a skewed join partition is split into at most
 #define TIME_DIFF_MICROS(start, end) \
   (((end.tv_sec - start.tv_sec) * 1000000L) + ((end.tv_nsec - start.tv_nsec) / 1000L))
 
 struct RDD;
 struct List;
+struct ShuffleFile;
+struct SortRanges;
+struct AdaptivePlan;
+struct SkewPlan;
+struct JoinTable;
 struct ListNode;
 struct ListIter;
+struct ListSlice;
+struct Block;
+struct MemoryManager;
 struct TaskQueue;
 struct ThreadPool;
+struct SchedPool;
+struct Job;
 
 typedef struct RDD RDD; // forward decl. of struct RDD
 typedef struct ListNode ListNode;
 typedef struct List List;
 typedef struct ListIter ListIter;
+typedef struct ListSlice ListSlice;
+typedef struct Block Block;
+typedef struct ShuffleFile ShuffleFile;
+typedef struct SortRanges SortRanges;
+typedef struct AdaptivePlan AdaptivePlan;
+typedef struct SkewPlan SkewPlan;
+typedef struct JoinTable JoinTable;
+typedef struct MemoryManager MemoryManager;
 typedef struct TaskQueue TaskQueue;
 typedef struct ThreadPool ThreadPool;
+typedef struct SchedPool SchedPool;
+typedef struct Job Job;
 typedef TaskQueue MonitorQueue;
 
 
@@ -39,14 +67,31 @@ struct ListNode{
   ListNode *next;
 };
 
+// Selected items of another list, which the view does not own
+struct ListSlice{
+  List *base; // always a concrete list
+  unsigned char *bitmap; // bit i is set if item i of base is selected, NULL selects all
+  int selected;
+};
+
+// A list is either concrete (owns its nodes) or a view over slices of concrete lists,
+// in which case head and tail are NULL and num_items is the number of selected items
 struct List{
   ListNode *head;
   ListNode *tail;
   int num_items;
+
+  ListSlice *slices; // NULL for concrete lists
+  int slices_cnt;
+
+  Block *block; // NULL unless the memory manager may spill the list
 };
 
 struct ListIter{
   ListNode *current;
+  List *list;
+  int slice; // slice of current, always 0 for concrete lists
+  int index; // index of current inside of its (base) list
 };
 
 struct TaskQueue
@@ -56,9 +101,64 @@ struct TaskQueue
   int num_tasks;
 };
 
+// Policy used to order jobs inside of a pool, or pools inside of the thread pool
+typedef enum {
+  POOL_FIFO,
+  POOL_FAIR
+} SchedMode;
+
+struct SchedPool
+{
+  char *name;
+  SchedMode mode; // how jobs submitted to this pool are ordered
+  int weight; // share of workers relative to other pools with the same priority
+  int priority; // pools with higher priority are always served first
+  int running; // tasks currently executed on behalf of this pool
+  List *jobs; // active jobs submitted to this pool
+};
+
+struct Job
+{
+  int id;
+  SchedPool *pool;
+  RDD *root; // RDD materialized by the action
+  TaskQueue *queue; // tasks which were not handed out to a worker yet
+  int pending; // tasks which are either queued or running
+  int running;
+  List *active; // tasks being executed, speculative copies included
+  int *awaited; // partitions of root which an earlier job was still computing
+  int awaited_cnt;
+  bool done;
+  bool detached; // the driver left while speculative losers were still running
+  struct timespec submitted;
+
+  // queue wait statistics in usec
+  int tasks_cnt;
+  size_t wait_total;
+  size_t wait_max;
+};
+
+// Worker process of the local cluster, driven by one worker thread of the driver
+typedef struct {
+  pid_t pid;
+  int fd; // driver's end of the socket pair
+} Executor;
+
 struct ThreadPool
 {
-  TaskQueue *queue;
+  List *pools; // all scheduling pools, the default one included
+  SchedPool *default_pool;
+  SchedMode mode; // how pools share the workers
+  int jobs_cnt;
+  int awaiting; // drivers waiting for partitions of other jobs (guarded by work_mutex)
+  int visit_cnt; // stamp for DAG traversals
+  double speculation; // multiple of the stage median after which a task is copied, 0 if off
+  int speculated_cnt;
+
+  // observed task durations over all stages, used for stages without observations
+  size_t duration_total;
+  int duration_cnt;
+
   MonitorQueue *monitor_queue;
   pthread_t *threads;
   pthread_t *monitor_thread;
@@ -67,29 +167,136 @@ struct ThreadPool
   pthread_mutex_t work_mutex;
   pthread_mutex_t monitor_mutex;
 
-  pthread_cond_t work_start;
   pthread_cond_t work_ready;
   pthread_cond_t new_work;
   pthread_cond_t new_monitor;
 
-  bool started;
   bool shutdown;
   int numthreads;
+
+  // local cluster mode, executors_cnt is 0 when tasks run in the worker threads
+  Executor *executors;
+  int executors_cnt;
+};
+
+// Spilling state of a concrete partition, guarded by the memory manager lock. Items
+// handed to a consuming transformation (map, filter, join) belong to it afterwards,
+// so they are never written out or freed by the memory manager
+struct Block
+{
+  List *list;
+  RDD *owner; // provides the (de)serializer and the lineage
+  int pnum; // partition of owner, used to recompute the block
+  FILE *spill; // NULL until the block is spilled for the first time
+  unsigned long checksum; // of the spill file contents
+  bool resident; // false while the nodes only live in the spill file (or nowhere)
+  bool rebuilding; // some thread is recomputing the block from lineage
+  int pins; // pinned blocks are being read and stay resident
+  unsigned long last_used;
+  size_t item_bytes; // estimated memory per item
+  int live; // items which were not consumed yet
+  unsigned char *consumed; // bit i is set once item i was consumed
+};
+
+// Output of one parent partition of a partitionBy. Items are grouped by output partition,
+// output partition i is stored between offsets[i] and offsets[i + 1]
+struct ShuffleFile
+{
+  pthread_mutex_t lock;
+  bool written;
+  FILE *fp;
+  off_t *offsets;
+};
+
+// Output ranges of the items of one parent partition of a sortBy, found once by the first
+// task which reads the parent partition. Slots are numbered like the nodes of the partition,
+// the slots of a view's slices follow one another
+struct SortRanges
+{
+  pthread_mutex_t lock;
+  int *range; // sort partition of every slot, NULL until found
+  int *offsets; // first slot of every slice
+  int *last; // last slot of every sort partition, -1 if it has no items here
+};
+
+// Layout of an adaptive partitionBy. The partitioner picks one of a multiple of the hinted
+// number of buckets, and runs of neighbouring buckets form the output partitions. The
+// partitionBy RDDs on both sides of a join share one plan
+struct AdaptivePlan
+{
+  int buckets; // numpartitions passed to the partitioner
+  int *partition; // output partition of every bucket
+};
+
+// Layout of a join with skewed partitions. Every join partition reads one parent partition
+// of both sides; a skewed parent partition is read by several join partitions, each of which
+// joins a piece of the larger side with all of the other side
+struct SkewPlan
+{
+  int *partition; // parent partition of every join partition
+  int *piece; // piece of the parent partition every join partition reads
+  int *pieces; // per parent partition: pieces it was split into, 1 if it was not
+  int *side; // per parent partition: dependency whose items are split
+  int *left; // per parent partition: pieces which were not claimed yet (guarded by lock)
+};
+
+struct MemoryManager
+{
+  pthread_mutex_t lock;
+  size_t budget; // in bytes, 0 for unlimited
+  size_t used; // memory charged to resident blocks
+  List *blocks; // every registered block
+  unsigned long clock;
+  char *dir; // where spill files are created
+  pthread_cond_t rebuilt;
+  int spill_cnt;
+  int load_cnt;
+  int recompute_cnt;
+  size_t join_limit; // memory a hash join task may use for its tables, 0 for unlimited
+  int join_spill_cnt;
+  size_t sort_limit; // memory a sort task may use before writing sorted runs, 0 for unlimited
+  int sort_run_cnt;
 };
 
 // Different function pointer types used by minispark
 typedef void* (*Mapper)(void* arg);
+typedef void (*Emitter)(void* out, void* item); // appends item to the output partition
+typedef void (*FlatMapper)(void* arg, Emitter emit, void* out, void* ctx);
+typedef void (*PartitionFn)(struct ListIter* input, Emitter emit, void* out, void* ctx);
 typedef int (*Filter)(void* arg, void* pred);
 typedef void* (*Joiner)(void* arg1, void* arg2, void* arg);
 typedef unsigned long (*Partitioner)(void *arg, int numpartitions, void* ctx);
 typedef void (*Printer)(void* arg);
+typedef size_t (*Serializer)(void* arg, FILE* fp); // returns bytes written or 0 on failure
+typedef void* (*Deserializer)(FILE* fp); // returns NULL on failure
+typedef void (*Freer)(void* arg); // frees an element along with what it points to
+typedef unsigned long (*KeyHasher)(void* arg, void* ctx);
+typedef int (*KeyEquals)(void* arg1, void* arg2, void* ctx); // nonzero if the keys match
+typedef void* (*KeyFn)(void* arg); // returns a malloced copy of the sort key of an item
+typedef int (*Comparator)(void* key1, void* key2); // <0, 0 or >0 like strcmp
+
+// Join key of hashJoin, ctx is passed to both functions
+typedef struct {
+  KeyHasher hash;
+  KeyEquals equals;
+  void* ctx;
+} JoinKey;
 
 typedef enum {
   MAP,
   FILTER,
   JOIN,
   PARTITIONBY,
-  FILE_BACKED
+  FILE_BACKED,
+  BROADCAST,
+  SAMPLE,
+  SORT,
+  TOPK,
+  DISTINCT,
+  UNION,
+  FLATMAP,
+  MAPPARTITIONS,
+  COALESCE
 } Transform;
 
 struct RDD {    
@@ -99,27 +306,78 @@ struct RDD {
   List** partitions; // list of partitions
   int partitions_cnt; // number of partitions
   
-  RDD* dependencies[MAXDEPS];
-  int dependencies_cnt; // 0, 1, or 2
+  RDD** dependencies; // dependencies_cnt of them
+  int dependencies_cnt; // 0 for files, 2 for joins and sortBy, any number for unions, else 1
 
   // you may want extra data members here
   pthread_mutex_t lock;
   int materialized_cnt;
+  bool *scheduled; // partitions which were already handed to some job (guarded by queue_mutex)
+  bool *claimed; // partitions whose output was kept by one of the copies computing it
+  bool fused; // computes its dependency from lineage, which is not scheduled on its own (topK)
+
+  // used to spill partitions, NULL if the partitions must stay in memory
+  Serializer serialize;
+  Deserializer deserialize;
+  Freer freer; // frees elements which are dropped, NULL for plain free
+  ShuffleFile *shuffle; // one per parent partition for partitionBy, NULL otherwise
+  JoinKey *key; // set for hashJoin, broadcastJoin and distinct, NULL for the pairwise join
+  RDD *partitioned; // partitionBy whose placement of keys the partitions follow, NULL if unknown
+
+  // state shared by all tasks of a stage (guarded by lock): broadcastJoin's table over the
+  // small side, or sortBy's range boundaries
+  JoinTable *table;
+  void **bounds; // items whose keys split the output partitions
+  int bounds_cnt;
+  SortRanges *ranges; // one per parent partition of a sortBy, allocated with bounds
+  int *groups; // coalesce's first parent partition of every partition, NULL until known
+  AdaptivePlan *plan; // set once an adaptive partitionBy was planned
+  SkewPlan *skew; // set once a join with skewed partitions was planned
+  int shared_users; // tasks currently using the shared state
+  bool building; // a task builds the shared table outside of lock, others wait for built
+  pthread_cond_t built;
+  int shared_left; // partitions which were not claimed yet, the state goes with the last
+
+  // critical path bookkeeping (guarded by queue_mutex)
+  long rank; // scratch of rank_job, jobs sharing the stage may rank it differently
+  size_t duration_total; // sum of observed task durations in usec
+  int duration_cnt;
+  size_t *durations; // observed duration of each finished partition, for speculation
+  int durations_cnt;
+  int visit;
 };
 
+typedef struct {
+  int jobid;
+  char *pool;
+  int tasks;
+  struct timespec submitted;
+  size_t wait_avg; // in usec
+  size_t wait_max; // in usec
+  size_t duration; // in usec
+} JobMetric;
+
 typedef struct {
   struct timespec created;
   struct timespec scheduled;
   size_t duration; // in usec
   RDD* rdd;
   int pnum;
+  int items; // items in the partition the task produced, 0 if it failed or lost the race
+  JobMetric* job; // set only on the last task of a job
 } TaskMetric;
 
-typedef struct {
+typedef struct Task {
   RDD* rdd;
   int pnum;
   TaskMetric* metric;
   bool finalrdd;
+  Job* job;
+  int attempts; // failed attempts so far
+  long rank; // longest remaining path from the task's stage to the end of its job in usec
+  bool speculative; // duplicate of a straggling task
+  bool discarded; // lost the race against its copy, output was thrown away
+  struct Task* twin; // running copy of this task or the task this one copies, NULL if none
 } Task;
 
 //////// actions ////////
@@ -131,6 +389,13 @@ int count(RDD* dataset);
 // For example, p(element) for all elements.
 void print(RDD* dataset, Printer p);
 
+// Print the k greatest elements of "dataset" by "cmp" using "p", greatest first.
+// Every partition keeps only its own k greatest elements, which are merged at the end.
+// Unless "dataset" is materialized or depends on a shuffle, its partitions are computed
+// for the selection only, and the items which are not among the k greatest are freed
+// right away. "k" must not be negative.
+void topK(RDD* dataset, int k, Comparator cmp, Printer p);
+
 //////// transformations ////////
 
 // Create an RDD with "rdd" as its dependency and "fn"
@@ -142,37 +407,190 @@ RDD* map(RDD* rdd, Mapper fn);
 // when it is called as a Filter
 RDD* filter(RDD* rdd, Filter fn, void* ctx);
 
+// Create an RDD with "rdd" as its dependency and "fn"
+// as its transformation. "fn" is called once per element
+// and passes any number of new elements to emit(out, item),
+// which appends them to the output partition right away.
+// "ctx" should be passed to "fn" when it is called.
+RDD* flatMap(RDD* rdd, FlatMapper fn, void* ctx);
+
+// Create an RDD with "rdd" as its dependency and "fn"
+// as its transformation. "fn" is called once per partition
+// with an iterator over the whole input partition (see
+// iter_next) and emits the new elements like flatMap, so
+// setup can be done once per partition. "ctx" should be
+// passed to "fn" when it is called.
+RDD* mapPartitions(RDD* rdd, PartitionFn fn, void* ctx);
+
+/**
+ * Merges the partitions of rdd into numpartitions partitions without a shuffle. Each output
+ * partition is a view over a run of contiguous parent partitions, so no item is copied or
+ * hashed. The runs are picked once the parent partitions are known, so that every output
+ * partition gets about the same number of items
+ * 
+ * @param rdd - rdd to coalesce, not backed by files
+ * @param numpartitions - number of output partitions
+ * @return new RDD
+ */
+RDD* coalesce(RDD* rdd, int numpartitions);
+
 // Create an RDD with two dependencies, "rdd1" and "rdd2"
 // "ctx" should be passed to "fn" when it is called as a
 // Joiner.
 RDD* join(RDD* rdd1, RDD* rdd2, Joiner fn, void* ctx);
 
+/**
+ * Joins two RDDs on a key. Items whose keys are equal are passed to fn, which may still
+ * return NULL to drop the pair. A hash table is built over the partition of rdd2 and
+ * probed with rdd1. If the table would exceed the join memory (see MS_SetJoinMemory) and
+ * both sides have a serializer, the partitions are split into buckets by key hash and the
+ * buckets which do not fit are written to disk and joined one at a time. fn must return
+ * new items, not its arguments
+ * 
+ * @param rdd1 - probe side
+ * @param rdd2 - build side, preferably the smaller one
+ * @param key - how keys are hashed and compared
+ * @param fn - builds the output of a matching pair
+ * @param ctx - passed to fn
+ * @return new RDD
+ */
+RDD* hashJoin(RDD* rdd1, RDD* rdd2, JoinKey* key, Joiner fn, void* ctx);
+
+/**
+ * Joins any number of RDDs through a balanced tree of joins instead of a chain, so the
+ * tree is O(log n) deep and the joins of each level run in parallel. Inputs whose size is
+ * known because they are materialized are joined smallest first, the others keep their
+ * order after them. fn must be associative and commutative, and its output must keep the
+ * key it joined on, like SumJoin
+ * 
+ * @param rdds - inputs, at least one
+ * @param numrdds - number of inputs
+ * @param key - join key for hashJoin, or NULL for the pairwise join
+ * @param fn - builds the output of a matching pair
+ * @param ctx - passed to fn
+ * @return root of the tree, rdds[0] if there is a single input
+ */
+RDD* joinAll(RDD** rdds, int numrdds, JoinKey* key, Joiner fn, void* ctx);
+
+/**
+ * Joins every partition of a large RDD against the whole of a small one, without any
+ * shuffle. The small side is materialized once and a read-only hash table over it is
+ * shared by all tasks, which join the large side partition by partition. The small
+ * side stays in memory until every partition was joined. fn must return new items
+ * 
+ * @param big - probe side, the result has its partitioning
+ * @param small - build side, must fit in memory
+ * @param key - how keys are hashed and compared
+ * @param fn - builds the output of a matching pair (item of big, item of small)
+ * @param ctx - passed to fn
+ * @return new RDD
+ */
+RDD* broadcastJoin(RDD* big, RDD* small, JoinKey* key, Joiner fn, void* ctx);
+
+/**
+ * Sorts an RDD by key. Every partition of rdd is sampled in parallel, the samples give
+ * the boundaries of numpartitions key ranges. The first task reading a partition of rdd
+ * finds the range of each of its items, and each output partition collects the items of
+ * its range from the partitions which hold some and sorts them. Partition i only holds
+ * keys which are not greater than those of partition i + 1, so the result is ordered
+ * globally and print emits it in order. Every item is handed over to the result. A range
+ * which exceeds the sort memory (see MS_SetSortMemory) is sorted externally
+ * 
+ * @param rdd - rdd to sort
+ * @param key - extracts the key of an item
+ * @param cmp - orders keys
+ * @param numpartitions - number of output partitions
+ * @return new RDD
+ */
+RDD* sortBy(RDD* rdd, KeyFn key, Comparator cmp, int numpartitions);
+
+/**
+ * Keeps one item of every key. Each partition of rdd drops its own duplicates first, the
+ * remaining items are shuffled by key hash into numpartitions partitions, and those drop
+ * the duplicates which came from different partitions. Both steps use an open addressing
+ * hash set, so the work is linear in the number of items
+ * 
+ * @param rdd - rdd to deduplicate
+ * @param key - how keys are hashed and compared
+ * @param numpartitions - number of output partitions
+ * @return new RDD
+ */
+RDD* distinct(RDD* rdd, JoinKey* key, int numpartitions);
+
+/**
+ * Concatenates the partitions of several RDDs. The partitions of the union are the
+ * partitions of its parents, so nothing is copied and no tasks run for it. Unions among
+ * the parents are flattened. The parents may not be backed by files
+ * 
+ * @param rdds - parents, in the order their partitions appear in the union
+ * @param numrdds - number of parents
+ * @return new RDD
+ */
+RDD* unionRDDs(RDD** rdds, int numrdds);
+
 // Create an RDD with "rdd" as a dependency. The new RDD
 // will have "numpartitions" number of partitions, which
 // may be different than its dependency. "ctx" should be
 // passed to "fn" when it is called as a Partitioner.
+// If "rdd" is already partitioned by "fn" with the same
+// "ctx" into "numpartitions" partitions (see
+// preservesPartitioning), "rdd" itself is returned.
 RDD* partitionBy(RDD* rdd, Partitioner fn, int numpartitions, void* ctx);
 
+/**
+ * Declares that a map, flatMap, mapPartitions or join keeps the key its (first) dependency
+ * was partitioned by in every item, so the RDD keeps that partitioning. filter and distinct
+ * keep it on their own. A partitionBy of an RDD which is partitioned the same way is then
+ * skipped, and a join of two RDDs partitioned the same way joins each partition as soon as
+ * both sides of it are ready, instead of waiting for both sides as a whole
+ * 
+ * @param rdd - rdd whose items keep their keys
+ * @return rdd, for chaining
+ */
+RDD* preservesPartitioning(RDD* rdd);
+
 // Create an RDD which opens a list of files, one per
 // partition. The number of partitions in the RDD will be
 // equivalent to "numfiles."
 RDD* RDDFromFiles(char* filenames[], int numfiles);
 
 /**
- * Frees RDD with all of its associated data in partitions. Takes into account
- * if RDD was a FILE-BACKED
+ * Declares how elements of the RDD are written to and read back from spill files, which
+ * allows its partitions to be spilled under memory pressure, and how elements are freed
+ * when they are spilled or dropped. Filters and partitionBy inherit all three from their
+ * dependency
  * 
- * @param rdd - rdd to free
+ * @param rdd - rdd whose elements are described
+ * @param ser - writes one element to a file
+ * @param de - reads one element written by ser
+ * @param fr - frees one element, NULL if free is enough
+ * @return rdd, for chaining
  */
-void hard_free_rdd(RDD *rdd);
+RDD* withSerde(RDD* rdd, Serializer ser, Deserializer de, Freer fr);
+
+/**
+ * Frees an element of the RDD with its Freer, or with free if it has none
+ * 
+ * @param rdd - rdd the element belongs to
+ * @param data - element to free
+ */
+void free_item(RDD *rdd, void *data);
 
 /**
- * Frees RDD while sparing data inside of it (important for RDDs that do not create new memory such
- * as FILTER and PARTITION by RDD
+ * Frees a list like list_free, freeing the items of a concrete list with free_item
+ * 
+ * @param list - concrete list or view
+ * @param rdd - rdd the items belong to
+ */
+void list_free_items(List *list, RDD *rdd);
+
+/**
+ * Frees RDD with all of its associated data in partitions. Takes into account
+ * if RDD was a FILE-BACKED
  * 
  * @param rdd - rdd to free
  */
-void soft_free_rdd(RDD *rdd);
+void hard_free_rdd(RDD *rdd);
 
 //////// MiniSpark ////////
 
@@ -182,10 +600,11 @@ void soft_free_rdd(RDD *rdd);
  * @param rdd - rdd for which we want to materialize
  * @param pnum - partition number of materialization
  * @param finalrdd - indicated if it is the root rdd which we want to materialize with this task
+ * @param job - job on behalf of which the task is executed
  * 
  * @return new task to add to the queue
  */
-Task* create_task(RDD *rdd, int pnum, bool finalrdd);
+Task* create_task(RDD *rdd, int pnum, bool finalrdd, Job *job);
 
 // Submits work to the thread pool to materialize "rdd".
 void execute(RDD* rdd);
@@ -196,10 +615,159 @@ void execute_helper(RDD* rdd);
 // Creates the thread pool and monitoring thread.
 void MS_Run();
 
+/**
+ * Like MS_Run, but forks executor processes which compute the tasks. They talk to the
+ * driver over Unix domain sockets: the driver sends the task's transformation and its
+ * input partitions, the executor returns the serialized partition. Every task runs in a
+ * child of its executor, so a crashing user function only fails that attempt and the task
+ * is retried. Tasks of RDDs (or with inputs) lacking a serializer run in the driver.
+ * Function pointers and contexts are shared with the executors as of this call, so
+ * contexts must be set up before it
+ * 
+ * @param executors - number of executor processes, 0 for the threaded mode
+ */
+void MS_RunCluster(int executors);
+
 // Waits for work to be complete, destroys the thread pool, and frees
 // all RDDs allocated during runtime.
 void MS_TearDown();
 
+/**
+ * Sets how much memory materialized partitions may use before the least recently used
+ * ones are evicted. Partitions of RDDs with a serializer are spilled to disk, others are
+ * dropped and recomputed from their lineage when they are needed again
+ * 
+ * @param bytes - memory budget, 0 (default) for unlimited
+ */
+void MS_SetMemoryBudget(size_t bytes);
+
+/**
+ * Sets the directory where spill files are created (default: $TMPDIR or /tmp)
+ * 
+ * @param dir - existing writable directory
+ */
+void MS_SetSpillDir(char *dir);
+
+/**
+ * Returns the number of times a partition was spilled to disk
+ */
+int MS_SpillCount();
+
+/**
+ * Returns the number of times a lost partition was recomputed from its lineage
+ */
+int MS_RecomputeCount();
+
+/**
+ * Enables disk based shuffles for partitionBy of RDDs with a serializer. The items of
+ * every parent partition are written to a shuffle file grouped by output partition, and
+ * each output partition reads only its segment of every file. Joins read the outputs
+ * of their partitionBy dependencies, so they shuffle through the same files
+ * 
+ * @param enabled - true to shuffle through files, false (default) to shuffle in memory
+ */
+void MS_SetDiskShuffle(bool enabled);
+
+/**
+ * Returns the number of shuffle files written so far
+ */
+int MS_ShuffleFileCount();
+
+/**
+ * Makes the number of partitions of partitionBy adaptive. Before a partitionBy is
+ * scheduled its input is materialized, and the bytes headed for each of ADAPTIVE_SPLIT
+ * times numpartitions buckets are measured. Runs of neighbouring buckets then form output
+ * partitions of about bytes each, so numpartitions becomes a hint: small partitions are
+ * merged and large ones split, while equal keys still share a partition. A bucket is never
+ * split, so a partitionBy grows to at most ADAPTIVE_SPLIT times numpartitions partitions.
+ * The partitionBy RDDs feeding both sides of a join are measured together and share one
+ * plan, so the sides still agree on their partitions; a side whose partitions come from
+ * anything but a partitionBy makes the join keep the given partitions
+ * 
+ * @param bytes - target partition size, 0 (default) to use numpartitions as given
+ */
+void MS_SetAdaptivePartitions(size_t bytes);
+
+/**
+ * Splits skewed join partitions. Before a join is scheduled both sides are materialized
+ * and a partition holding more than factor times the median bytes of the join's partitions
+ * is split into pieces of about the median size (at most SKEW_MAX_PIECES). The pieces
+ * divide the items of the larger side, and every piece joins its items with all items of
+ * the other side, so hot keys are joined by several tasks. The items of every task's
+ * partition are reported in the metrics log
+ * 
+ * @param factor - how much larger than the median a partition may get, 0 (default) for off
+ */
+void MS_SetSkewJoin(double factor);
+
+/**
+ * Sets how much memory the hash table of a single hashJoin task may use before the
+ * join falls back to on-disk buckets
+ * 
+ * @param bytes - limit, 0 (default) for unlimited
+ */
+void MS_SetJoinMemory(size_t bytes);
+
+/**
+ * Returns the number of hash join buckets which were written to disk
+ */
+int MS_JoinSpillCount();
+
+/**
+ * Sets how much memory the items of a single sort task may use. Beyond that a sort whose
+ * input has a serializer writes sorted runs to disk and merges them at the end
+ * 
+ * @param bytes - limit, 0 (default) for unlimited
+ */
+void MS_SetSortMemory(size_t bytes);
+
+/**
+ * Returns the number of sorted runs which were written to disk
+ */
+int MS_SortRunCount();
+
+/**
+ * Sets how the workers are shared between scheduling pools. With POOL_FIFO jobs are served
+ * strictly by pool priority and then by submission order. With POOL_FAIR pools with higher
+ * priority are served first and pools with the same priority share workers by weight.
+ * 
+ * @param mode - POOL_FIFO (default) or POOL_FAIR
+ */
+void MS_SetSchedulingMode(SchedMode mode);
+
+/**
+ * Creates a new scheduling pool which jobs can be submitted to
+ * 
+ * @param name - name of the pool used in the metrics log
+ * @param mode - how jobs inside of the pool are ordered
+ * @param weight - share of workers relative to other pools of the same priority
+ * @param priority - pools with higher priority are always served first
+ * @return the new pool
+ */
+SchedPool* MS_CreatePool(char *name, SchedMode mode, int weight, int priority);
+
+/**
+ * Sets the pool which actions invoked by the calling thread are submitted to
+ * 
+ * @param pool - pool created by MS_CreatePool or NULL for the default pool
+ */
+void MS_SetPool(SchedPool *pool);
+
+/**
+ * Enables speculative execution. Once SPECULATION_QUANTILE of a stage's partitions are
+ * done, an idle worker launches a copy of any task of that stage which runs longer than
+ * multiplier times the stage median. The first copy to finish is kept and the output of
+ * the other one is discarded, so user functions must be deterministic and side effect free
+ * 
+ * @param multiplier - straggler threshold relative to the median, 0 disables speculation
+ */
+void MS_SetSpeculation(double multiplier);
+
+/**
+ * Returns the number of speculative copies launched so far
+ */
+int MS_SpeculatedCount();
+
 /**
  * Initializes an empty list of void * elements
  * 
@@ -207,6 +775,48 @@ void MS_TearDown();
  */
 List* list_init();
 
+/**
+ * Initializes an empty view. Slices are added with list_view_add and items are selected with
+ * list_view_select
+ * 
+ * @returns pointer to the view
+ */
+List* list_view_init();
+
+/**
+ * Adds the items of list to the view as unselected slices. A concrete list becomes a single
+ * slice, the slices of a view are added as they are so views never nest
+ * 
+ * @param view - view to extend
+ * @param list - concrete list or view
+ * @returns slice number in view corresponding to the first slice of list
+ */
+int list_view_add(List *view, List *list);
+
+/**
+ * Selects an item of the view
+ * 
+ * @param view - view to select in
+ * @param slice - slice number as reported by an iterator over the list which was added
+ * @param indx - index of the item inside of the slice's base list
+ */
+void list_view_select(List *view, int slice, int indx);
+
+/**
+ * Adds a list to the view with all of its items selected, a view keeps its own selection
+ * 
+ * @param view - view to extend
+ * @param list - concrete list or view
+ */
+void list_view_add_all(List *view, List *list);
+
+/**
+ * Drops slices with no selected items and bitmaps which select everything
+ * 
+ * @param view - view which won't be modified any further
+ */
+void list_view_finish(List *view);
+
 /**
  * Adds new element data to the list. Importantly it copies the address of the data without cleaning it
  * 
@@ -234,7 +844,8 @@ void* list_get(List *list, int indx);
 ListIter list_get_iter(List *list);
 
 /**
- * Gets next element from the list
+ * Gets next element from the list. Afterwards iter->slice and iter->index - 1 locate the
+ * element inside of the list's bases
  * 
  * @param iter - iterator created from the list
  * @return data element or NULL if we reached the end
@@ -242,7 +853,8 @@ ListIter list_get_iter(List *list);
 void* iter_next(ListIter *iter);
 
 /**
- * Frees list and all of its associated data
+ * Frees list and all of its associated data. Views only free their selection since the
+ * data belongs to their base lists
  * 
  * @param list - list of elements
  */
@@ -255,6 +867,15 @@ void list_free(List *list);
  */
 void list_node_free(List *list);
 
+/**
+ * Removes the first occurrence of data from the list without freeing it
+ * 
+ * @param list - list of elements
+ * @param data - data pointer to remove
+ * @return true if the element was found and false otherwise
+ */
+bool list_remove(List *list, void *data);
+
 /**
  * Initializes empty task queue to work with
  * 
@@ -278,6 +899,409 @@ bool queue_push(TaskQueue *queue, Task *task);
  */
 Task* queue_pop(TaskQueue *queue);
 
+/**
+ * Returns the ready task with the longest remaining path to the end of its job. Ties are
+ * broken by queue order
+ * 
+ * @param queue - task queue from which to pop
+ * @return ready task or NULL if none of the queued tasks can run yet
+ */
+Task* queue_pop_ready(TaskQueue *queue);
+
+/**
+ * Estimates how long a task of the RDD takes. Uses the mean observed task duration of the
+ * stage if there is one, and the mean over all stages otherwise
+ * 
+ * @param rdd - stage to estimate
+ * @return estimated task duration in usec
+ */
+long stage_cost(RDD *rdd);
+
+/**
+ * Computes for every stage of the job the longest path (sum of stage costs) from it to the
+ * job's final RDD, which becomes the priority of the job's queued tasks. Must be called with
+ * queue_mutex held
+ * 
+ * @param job - job whose stages are ranked
+ */
+void rank_job(Job *job);
+
+/**
+ * Collects the stages reachable from rdd in postorder, dependencies before consumers. Must
+ * be called with queue_mutex held, after bumping the pool's visit stamp
+ * 
+ * @param rdd - last stage
+ * @param stages - growing array of stages
+ * @param cnt - number of collected stages
+ * @param cap - capacity of stages
+ */
+void collect_stages(RDD *rdd, RDD ***stages, int *cnt, int *cap);
+
+/**
+ * Picks the next ready task according to the scheduling policy. Must be called with
+ * queue_mutex held
+ * 
+ * @return ready task or NULL if there is nothing to run
+ */
+Task* schedule_task();
+
+/**
+ * Allocates a new RDD, dependencies are passed as variable arguments
+ * 
+ * @param numdeps - number of dependencies
+ * @param t - transformation
+ * @param fn - transformation function
+ * @return new RDD without partitions
+ */
+RDD *create_rdd(int numdeps, Transform t, void *fn, ...);
+
+/**
+ * Allocates a new RDD with any number of dependencies
+ * 
+ * @param numdeps - number of dependencies
+ * @param t - transformation
+ * @param fn - transformation function
+ * @param deps - dependencies, copied
+ * @return new RDD without partitions
+ */
+RDD *create_rdd_deps(int numdeps, Transform t, void *fn, RDD **deps);
+
+/**
+ * Links the partitions which the parents of a union materialized since the last call
+ * 
+ * @param rdd - union
+ */
+void union_sync(RDD *rdd);
+
+/**
+ * Returns true if both sides of a join are partitioned by the same partitionBy function,
+ * context and number of partitions, so partition i of the join only needs partition i of
+ * both sides
+ * 
+ * @param rdd - join rdd
+ * @return true if the sides are co-partitioned
+ */
+bool co_partitioned(RDD *rdd);
+
+/**
+ * Opens partition pnum of a dependency for reading, see compute_partition for fresh
+ * 
+ * @param dep - dependency
+ * @param pnum - partition number
+ * @param fresh - recompute the partition from lineage
+ * @return the input, or NULL if its file could not be opened
+ */
+List* open_input(RDD *dep, int pnum, bool fresh);
+
+/**
+ * Releases an input returned by open_input
+ * 
+ * @param dep - dependency
+ * @param input - the input
+ * @param fresh - as passed to open_input
+ */
+void close_input(RDD *dep, List *input, bool fresh);
+
+/**
+ * Computes a partition of a hashJoin, see compute_partition
+ * 
+ * @param rdd - hashJoin rdd
+ * @param pnum - partition number
+ * @param fresh - recompute the inputs from lineage
+ * @param discarded - set if another copy of the task kept its output
+ * @return the partition, or NULL
+ */
+List* hash_join(RDD *rdd, int pnum, bool fresh, bool *discarded);
+
+/**
+ * Opens the items one side of a join partition reads: the whole parent partition, or
+ * a piece of it if the partition was split because of skew
+ * 
+ * @param rdd - join rdd
+ * @param side - dependency to read
+ * @param pnum - partition of the join
+ * @param fresh - as passed to open_input
+ * @param input - set to the opened parent partition, passed to join_close
+ * @return the items to join, or NULL
+ */
+List *join_open(RDD *rdd, int side, int pnum, bool fresh, List **input);
+
+/**
+ * Consumes what a claimed join partition read of one side. A piece consumes its own items,
+ * the side read whole by all pieces is consumed by the last piece to be claimed
+ * 
+ * @param rdd - join rdd
+ * @param side - dependency which was read
+ * @param pnum - partition of the join
+ * @param list - as returned by join_open
+ */
+void join_consume(RDD *rdd, int side, int pnum, List *list);
+
+/**
+ * Closes what join_open opened
+ * 
+ * @param rdd - join rdd
+ * @param side - dependency which was read
+ * @param fresh - as passed to join_open
+ * @param list - as returned by join_open
+ * @param input - as set by join_open
+ */
+void join_close(RDD *rdd, int side, bool fresh, List *list, List *input);
+
+/**
+ * Computes a partition of a broadcastJoin, see compute_partition
+ * 
+ * @param rdd - broadcastJoin rdd
+ * @param pnum - partition number
+ * @param fresh - recompute the inputs from lineage
+ * @param discarded - set if another copy of the task kept its output
+ * @return the partition, or NULL
+ */
+List* broadcast_join(RDD *rdd, int pnum, bool fresh, bool *discarded);
+
+/**
+ * Computes a partition of sortBy's sampling stage, see compute_partition
+ * 
+ * @param rdd - sampling rdd
+ * @param pnum - partition number
+ * @param fresh - recompute the input from lineage
+ * @param discarded - set if another copy of the task kept its output
+ * @return the sampled keys, or NULL
+ */
+List* sample_partition(RDD *rdd, int pnum, bool fresh, bool *discarded);
+
+/**
+ * Computes a partition of sortBy, see compute_partition
+ * 
+ * @param rdd - sortBy rdd
+ * @param pnum - partition number
+ * @param fresh - recompute the inputs from lineage
+ * @param discarded - set if another copy of the task kept its output
+ * @return the sorted partition, or NULL
+ */
+List* sort_partition(RDD *rdd, int pnum, bool fresh, bool *discarded);
+
+/**
+ * Computes a partition of topK's selection stage, see compute_partition
+ * 
+ * @param rdd - selection rdd
+ * @param pnum - partition number
+ * @param fresh - recompute the input from lineage
+ * @param discarded - set if another copy of the task kept its output
+ * @return the k greatest items of the partition, or NULL
+ */
+List* topk_partition(RDD *rdd, int pnum, bool fresh, bool *discarded);
+
+/**
+ * Computes a partition of one of distinct's deduplication stages, see compute_partition
+ * 
+ * @param rdd - deduplicating rdd
+ * @param pnum - partition number
+ * @param fresh - recompute the input from lineage
+ * @param discarded - set if another copy of the task kept its output
+ * @return the first item of every key in the partition, or NULL
+ */
+List* distinct_partition(RDD *rdd, int pnum, bool fresh, bool *discarded);
+
+/**
+ * Splits partitions into runs of contiguous partitions with about the same number of items
+ * 
+ * @param sizes - number of items of every partition
+ * @param cnt - number of partitions
+ * @param numgroups - number of runs
+ * @param groups - receives the first partition of every run followed by cnt, numgroups + 1 entries
+ */
+void group_partitions(long *sizes, int cnt, int numgroups, int *groups);
+
+/**
+ * Computes a partition of coalesce, see compute_partition
+ * 
+ * @param rdd - coalescing rdd
+ * @param pnum - partition number
+ * @param fresh - recompute the inputs from lineage
+ * @param discarded - set if another copy of the task kept its output
+ * @return the partition, or NULL
+ */
+List* coalesce_partition(RDD *rdd, int pnum, bool fresh, bool *discarded);
+
+/**
+ * Scrambles a user supplied hash, whose low bits may already have picked the partition
+ * 
+ * @param hash - hash to scramble
+ * @return scrambled hash
+ */
+unsigned long mix_hash(unsigned long hash);
+
+/**
+ * Allocates partition bookkeeping once the number of partitions is known
+ * 
+ * @param rdd - rdd to set up
+ * @param numpartitions - number of partitions
+ */
+void alloc_partitions(RDD *rdd, int numpartitions);
+
+/**
+ * Marks a partition as computed. Only the first copy of a task which claims its
+ * partition keeps the output. Speculative copies compute from lineage, so only the
+ * original reads (and consumes) the materialized inputs, whether it wins or not
+ * 
+ * @param rdd - rdd being computed
+ * @param pnum - partition number
+ * @return true for the first claim
+ */
+bool claim_partition(RDD *rdd, int pnum);
+
+/**
+ * Throws away the output of an original task which lost its claim to a speculative copy.
+ * The inputs were consumed as if it had won, so the output owns its items and frees them
+ * 
+ * @param rdd - rdd the items belong to
+ * @param list - computed partition
+ * @param discarded - set to true
+ * @return NULL
+ */
+List* discard_partition(RDD *rdd, List *list, bool *discarded);
+
+/**
+ * Opens an anonymous file in the spill directory which disappears once it is closed
+ * 
+ * @return the file open for reading and writing
+ */
+FILE *spill_open();
+
+/**
+ * Allocates the shuffle bookkeeping of a partitionBy
+ * 
+ * @param cnt - number of parent partitions
+ * @return shuffle files, none of them written yet
+ */
+ShuffleFile *shuffle_alloc(int cnt);
+
+/**
+ * Plans the adaptive partitionBy RDDs and the skewed joins in the lineage of rdd which were
+ * not scheduled yet, see MS_SetAdaptivePartitions and MS_SetSkewJoin. Their inputs are
+ * materialized by jobs of their own and the partition counts of the RDDs downstream are
+ * updated to match
+ * 
+ * @param rdd - rdd about to be executed
+ */
+void plan_adaptive(RDD *rdd);
+
+/**
+ * Returns the output partition of an item of a partitionBy
+ * 
+ * @param rdd - partitionBy rdd
+ * @param data - item
+ * @return output partition
+ */
+int partition_of(RDD *rdd, void *data);
+
+/**
+ * Closes every shuffle file, called by MS_TearDown
+ */
+void shuffle_destroy();
+
+/**
+ * Checks whether a partitionBy shuffles through files
+ * 
+ * @param rdd - partitionBy rdd
+ * @return true if disk shuffles are enabled and the items can be serialized
+ */
+bool shuffle_eligible(RDD *rdd);
+
+/**
+ * Reads an output partition of a partitionBy from the shuffle files, writing the files
+ * of parent partitions nobody has read yet
+ * 
+ * @param rdd - partitionBy rdd
+ * @param pnum - output partition
+ * @return deserialized copies of the partition's items
+ */
+List* shuffle_read(RDD *rdd, int pnum);
+
+/**
+ * Forks the executor processes, called by MS_RunCluster
+ * 
+ * @param executors - number of processes
+ */
+void cluster_init(int executors);
+
+/**
+ * Closes the sockets, which makes the executors exit, and reaps them
+ */
+void cluster_destroy();
+
+/**
+ * Checks whether a task of the RDD can be shipped to an executor, which needs
+ * serializers for its output and for every input which is not a file
+ * 
+ * @param rdd - rdd to compute
+ * @return true if the task can run remotely
+ */
+bool remote_eligible(RDD *rdd);
+
+/**
+ * Computes a partition on an executor, blocking until it answers
+ * 
+ * @param executor - executor owned by the calling worker thread
+ * @param rdd - rdd to compute
+ * @param pnum - partition number
+ * @return deserialized partition, or NULL if the task failed
+ */
+List* remote_compute(Executor *executor, RDD *rdd, int pnum);
+
+/**
+ * Initializes the memory manager, called by MS_Run
+ */
+void memory_init();
+
+/**
+ * Closes all spill files and destroys the memory manager, called by MS_TearDown
+ */
+void memory_destroy();
+
+/**
+ * Puts a freshly materialized concrete partition under the memory budget. Does nothing
+ * without a budget. May evict other partitions
+ * 
+ * @param list - concrete partition
+ * @param owner - RDD the partition belongs to
+ * @param pnum - partition number inside of owner
+ */
+void block_register(List *list, RDD *owner, int pnum);
+
+/**
+ * Makes sure the list (or every base of a view) is resident and keeps it resident until
+ * list_unpin. Spilled blocks are read back, dropped blocks and blocks whose spill file is
+ * corrupted are recomputed from lineage
+ * 
+ * @param list - concrete list or view to read
+ */
+void list_pin(List *list);
+
+/**
+ * Releases a pin taken by list_pin and spills blocks if the budget is exceeded
+ * 
+ * @param list - concrete list or view which was pinned
+ */
+void list_unpin(List *list);
+
+/**
+ * Marks every item of the list (or selected by the view) as consumed
+ * 
+ * @param list - concrete list or view which was read by a consuming transformation
+ */
+void list_consume(List *list);
+
+/**
+ * Marks items of the list as consumed unless kept selects them. kept must be a view
+ * created by list_view_add(kept, list) which was not finished yet
+ * 
+ * @param list - concrete list or view which was filtered
+ * @param kept - view of the surviving items
+ */
+void list_consume_except(List *list, List *kept);
+
 /**
  * Main function to monitor and print out task completion time to log file
  * 
@@ -306,8 +1330,34 @@ bool validate_task(Task *task);
  * Once dependancies have been checked, materializes partition depending on transit
  * 
  * @param task - work that must be done
+ * @return false if the task failed and should be retried
+ */
+bool resolve_task(Task *task);
+
+/**
+ * Called with queue_mutex held by idle workers. Launches a copy of the longest running
+ * straggler, if speculation is enabled and there is one
+ * 
+ * @return the copy, or NULL
+ */
+Task* speculate_task();
+
+/**
+ * Computes a partition of the RDD. Normally the materialized partitions of its dependencies
+ * are read, and filter and partitionBy produce views over them. With fresh set, the inputs
+ * are recomputed from lineage instead (down to the input files) and the result is a
+ * concrete list which owns its items. Transformations must be deterministic for the
+ * recomputed partition to match the original
+ * 
+ * @param rdd - rdd to compute
+ * @param pnum - partition number
+ * @param fresh - recompute the inputs from lineage rather than reading them
+ * @param discarded - unless fresh, set when another copy of the task already kept its
+ *                    output; the inputs are then consumed as if this copy had won, its
+ *                    output is freed and NULL is returned
+ * @return the partition or NULL if an input file could not be opened (or it was discarded)
  */
-void resolve_task(Task *task);
+List* compute_partition(RDD *rdd, int pnum, bool fresh, bool *discarded);
 
 
 // Helper function to print string representation of Transform enum
@@ -0,0 +1,156 @@
+#define _GNU_SOURCE
+#include "minispark.h"
+
+bool disk_shuffle = false;
+int shuffle_files_cnt = 0;
+pthread_mutex_t shuffle_lock = PTHREAD_MUTEX_INITIALIZER;
+List *shuffle_files = NULL; // every written shuffle file, closed by shuffle_destroy
+
+void MS_SetDiskShuffle(bool enabled)
+{
+  pthread_mutex_lock(&shuffle_lock);
+  disk_shuffle = enabled;
+  pthread_mutex_unlock(&shuffle_lock);
+}
+
+int MS_ShuffleFileCount()
+{
+  pthread_mutex_lock(&shuffle_lock);
+  int cnt = shuffle_files_cnt;
+  pthread_mutex_unlock(&shuffle_lock);
+  return cnt;
+}
+
+void shuffle_destroy()
+{
+  pthread_mutex_lock(&shuffle_lock);
+  if (shuffle_files != NULL)
+  {
+    ListIter iter = list_get_iter(shuffle_files);
+    ShuffleFile *file;
+    while ((file = iter_next(&iter)) != NULL)
+    {
+      fclose(file->fp);
+      file->fp = NULL;
+      free(file->offsets);
+      file->offsets = NULL;
+      file->written = false;
+    }
+    list_node_free(shuffle_files);
+    shuffle_files = NULL;
+  }
+  pthread_mutex_unlock(&shuffle_lock);
+}
+
+ShuffleFile *shuffle_alloc(int cnt)
+{
+  ShuffleFile *files = calloc(cnt, sizeof(ShuffleFile));
+  for (int i = 0; i < cnt; i++)
+    pthread_mutex_init(&files[i].lock, NULL);
+  return files;
+}
+
+bool shuffle_eligible(RDD *rdd)
+{
+  pthread_mutex_lock(&shuffle_lock);
+  bool enabled = disk_shuffle;
+  pthread_mutex_unlock(&shuffle_lock);
+  RDD *dep = rdd->dependencies[0];
+  return enabled && rdd->shuffle != NULL && rdd->serialize != NULL && rdd->deserialize != NULL &&
+         dep->trans != FILE_BACKED;
+}
+
+/* Buckets parent partition ppnum by output partition and writes the buckets one after
+ * another, so every output partition is a contiguous segment. Called with file->lock held */
+void shuffle_write(RDD *rdd, int ppnum, ShuffleFile *file)
+{
+  RDD *dep = rdd->dependencies[0];
+  int cnt = rdd->partitions_cnt;
+  List *buckets[cnt];
+  for (int i = 0; i < cnt; i++)
+    buckets[i] = list_init();
+
+  List *partition = dep->partitions[ppnum];
+  list_pin(partition);
+  ListIter iter = list_get_iter(partition);
+  void *data;
+  while ((data = iter_next(&iter)) != NULL)
+  {
+    int pnum = partition_of(rdd, data);
+    list_add(buckets[pnum], data);
+  }
+
+  file->fp = spill_open();
+  file->offsets = malloc(sizeof(off_t) * (cnt + 1));
+  for (int i = 0; i < cnt; i++)
+  {
+    file->offsets[i] = ftello(file->fp);
+    iter = list_get_iter(buckets[i]);
+    while ((data = iter_next(&iter)) != NULL)
+    {
+      if (rdd->serialize(data, file->fp) == 0)
+      {
+        printf("error writing shuffle file of RDD %p\n", (void *)rdd);
+        exit(1);
+      }
+    }
+    list_node_free(buckets[i]);
+  }
+  file->offsets[cnt] = ftello(file->fp);
+  fflush(file->fp);
+
+  // Readers deserialize their own copies, the parent items are handed over like a view's
+  iter = list_get_iter(partition);
+  while ((data = iter_next(&iter)) != NULL)
+    free_item(dep, data);
+  list_consume(partition);
+  list_unpin(partition);
+  file->written = true;
+
+  pthread_mutex_lock(&shuffle_lock);
+  if (shuffle_files == NULL)
+    shuffle_files = list_init();
+  list_add(shuffle_files, file);
+  shuffle_files_cnt += 1;
+  pthread_mutex_unlock(&shuffle_lock);
+}
+
+List *shuffle_read(RDD *rdd, int pnum)
+{
+  RDD *dep = rdd->dependencies[0];
+  List *newpartition = list_init();
+  for (int i = 0; i < dep->partitions_cnt; i++)
+  {
+    // The first reader of a parent partition writes its shuffle file
+    ShuffleFile *file = &rdd->shuffle[i];
+    pthread_mutex_lock(&file->lock);
+    if (!file->written)
+      shuffle_write(rdd, i, file);
+    pthread_mutex_unlock(&file->lock);
+
+    // Only this partition's segment is read, concurrent readers don't share a file position
+    size_t len = file->offsets[pnum + 1] - file->offsets[pnum];
+    if (len == 0)
+      continue;
+    char *buf = malloc(len);
+    if (pread(fileno(file->fp), buf, len, file->offsets[pnum]) != (ssize_t)len)
+    {
+      printf("error reading shuffle file of RDD %p\n", (void *)rdd);
+      exit(1);
+    }
+    FILE *segment = fmemopen(buf, len, "r");
+    while (ftello(segment) < (off_t)len)
+    {
+      void *data = rdd->deserialize(segment);
+      if (data == NULL)
+      {
+        printf("error reading shuffle file of RDD %p\n", (void *)rdd);
+        exit(1);
+      }
+      list_add(newpartition, data);
+    }
+    fclose(segment);
+    free(buf);
+  }
+  return newpartition;
+}
@@ -0,0 +1,787 @@
+#define _GNU_SOURCE
+#include <malloc.h>
+#include "minispark.h"
+
+extern MemoryManager *memory;
+
+// An item together with its key, so that the key is extracted once per sort
+typedef struct
+{
+  void *key;
+  void *data;
+} SortEntry;
+
+// Sorts the items added to it, in memory or through sorted runs on disk
+typedef struct
+{
+  KeyFn keyfn;
+  Comparator cmp;
+  Serializer serialize;
+  Deserializer deserialize;
+  RDD *dep; // frees the items
+  bool owned; // items are freed once they were written to a run
+  size_t limit; // 0 unless the items may be written to runs
+  SortEntry *entries;
+  int cnt;
+  int cap;
+  size_t bytes;
+  FILE **runs;
+  int runs_cnt;
+} Sorter;
+
+// Head item of every run during a merge, data is NULL once a run is exhausted
+typedef struct
+{
+  FILE *fp;
+  void *data;
+  void *key;
+} RunHead;
+
+void MS_SetSortMemory(size_t bytes)
+{
+  pthread_mutex_lock(&memory->lock);
+  memory->sort_limit = bytes;
+  pthread_mutex_unlock(&memory->lock);
+}
+
+int MS_SortRunCount()
+{
+  pthread_mutex_lock(&memory->lock);
+  int cnt = memory->sort_run_cnt;
+  pthread_mutex_unlock(&memory->lock);
+  return cnt;
+}
+
+RDD *sortBy(RDD *dep, KeyFn key, Comparator cmp, int numpartitions)
+{
+  // The keys sampled by every partition of dep give the boundaries of the output ranges
+  RDD *sample = create_rdd(1, SAMPLE, key, dep);
+  alloc_partitions(sample, dep->partitions_cnt);
+
+  RDD *rdd = create_rdd(2, SORT, cmp, dep, sample);
+  alloc_partitions(rdd, numpartitions);
+  rdd->ctx = key;
+  rdd->shared_left = numpartitions;
+  withSerde(rdd, dep->serialize, dep->deserialize, dep->freer);
+  return rdd;
+}
+
+int compare_keys(const void *a, const void *b, void *cmp)
+{
+  return ((Comparator)cmp)(*(void **)a, *(void **)b);
+}
+
+int compare_entries(const void *a, const void *b, void *cmp)
+{
+  return ((Comparator)cmp)(((SortEntry *)a)->key, ((SortEntry *)b)->key);
+}
+
+List *sample_partition(RDD *rdd, int pnum, bool fresh, bool *discarded)
+{
+  RDD *dep = rdd->dependencies[0];
+  List *input = open_input(dep, pnum, fresh);
+  if (input == NULL)
+    return NULL;
+
+  // Evenly spaced items, so that sorted input does not skew the sample
+  int cnt = 0;
+  ListIter iter = list_get_iter(input);
+  while (iter_next(&iter) != NULL)
+    cnt++;
+  int step = cnt > SORT_SAMPLES ? cnt / SORT_SAMPLES : 1;
+
+  List *newpartition = list_init();
+  iter = list_get_iter(input);
+  void *data;
+  for (int i = 0; (data = iter_next(&iter)) != NULL; i++)
+  {
+    if (i % step == step / 2 && newpartition->num_items < SORT_SAMPLES)
+      list_add(newpartition, ((KeyFn)rdd->fn)(data));
+    if (fresh)
+      free_item(dep, data);
+  }
+
+  // Sampling leaves the input to the sort, the keys are copies
+  close_input(dep, input, fresh);
+  if (fresh || claim_partition(rdd, pnum))
+    return newpartition;
+  list_free(newpartition);
+  *discarded = true;
+  return NULL;
+}
+
+/* Picks numpartitions - 1 boundaries out of the sampled keys, which stay owned by samples */
+void **sort_bounds(RDD *rdd, List **samples, int *bounds_cnt)
+{
+  RDD *sample = rdd->dependencies[1];
+  int cnt = 0;
+  for (int i = 0; i < sample->partitions_cnt; i++)
+    cnt += samples[i]->num_items;
+
+  void **keys = malloc(sizeof(void *) * (cnt + 1));
+  int k = 0;
+  for (int i = 0; i < sample->partitions_cnt; i++)
+  {
+    ListIter iter = list_get_iter(samples[i]);
+    void *key;
+    while ((key = iter_next(&iter)) != NULL)
+      keys[k++] = key;
+  }
+  qsort_r(keys, k, sizeof(void *), compare_keys, rdd->fn);
+
+  void **bounds = malloc(sizeof(void *) * rdd->partitions_cnt);
+  *bounds_cnt = 0;
+  for (int i = 1; i < rdd->partitions_cnt && k > 0; i++)
+    bounds[(*bounds_cnt)++] = keys[(long)i * k / rdd->partitions_cnt];
+  free(keys);
+  return bounds;
+}
+
+/* Returns the shared boundaries, the first task picks them and pins the samples */
+void **sort_acquire(RDD *rdd, int *bounds_cnt)
+{
+  RDD *dep = rdd->dependencies[0];
+  RDD *sample = rdd->dependencies[1];
+  pthread_mutex_lock(&rdd->lock);
+  if (rdd->bounds == NULL)
+  {
+    for (int i = 0; i < sample->partitions_cnt; i++)
+      list_pin(sample->partitions[i]);
+    rdd->bounds = sort_bounds(rdd, sample->partitions, &rdd->bounds_cnt);
+    rdd->ranges = calloc(dep->partitions_cnt, sizeof(SortRanges));
+    for (int i = 0; i < dep->partitions_cnt; i++)
+      pthread_mutex_init(&rdd->ranges[i].lock, NULL);
+  }
+  rdd->shared_users += 1;
+  void **bounds = rdd->bounds;
+  *bounds_cnt = rdd->bounds_cnt;
+  pthread_mutex_unlock(&rdd->lock);
+  return bounds;
+}
+
+/* Drops the boundaries once every partition was claimed and nobody reads them anymore */
+void sort_release(RDD *rdd, bool claimed)
+{
+  RDD *sample = rdd->dependencies[1];
+  pthread_mutex_lock(&rdd->lock);
+  rdd->shared_users -= 1;
+  if (claimed)
+    rdd->shared_left -= 1;
+  if (rdd->shared_left == 0 && rdd->shared_users == 0 && rdd->bounds != NULL)
+  {
+    free(rdd->bounds);
+    rdd->bounds = NULL;
+    for (int i = 0; i < sample->partitions_cnt; i++)
+      list_unpin(sample->partitions[i]);
+    for (int i = 0; i < rdd->dependencies[0]->partitions_cnt; i++)
+    {
+      pthread_mutex_destroy(&rdd->ranges[i].lock);
+      free(rdd->ranges[i].range);
+      free(rdd->ranges[i].offsets);
+      free(rdd->ranges[i].last);
+    }
+    free(rdd->ranges);
+    rdd->ranges = NULL;
+  }
+  pthread_mutex_unlock(&rdd->lock);
+}
+
+/* Output partition of a key: the number of boundaries below it */
+int sort_range(RDD *rdd, void **bounds, int bounds_cnt, void *key)
+{
+  int lo = 0;
+  int hi = bounds_cnt;
+  while (lo < hi)
+  {
+    int mid = (lo + hi) / 2;
+    if (((Comparator)rdd->fn)(bounds[mid], key) < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+/* Returns the ranges of the items of an open parent partition, the first reader finds them.
+ * Every item's key is extracted once per sort this way, not once per sort partition */
+SortRanges *sort_ranges(RDD *rdd, void **bounds, int bounds_cnt, int ppnum, List *input)
+{
+  SortRanges *ranges = &rdd->ranges[ppnum];
+  pthread_mutex_lock(&ranges->lock);
+  if (ranges->range == NULL)
+  {
+    int slices = input->slices != NULL ? input->slices_cnt : 1;
+    ranges->offsets = malloc(sizeof(int) * slices);
+    int slots = 0;
+    for (int i = 0; i < slices; i++)
+    {
+      ranges->offsets[i] = slots;
+      slots += input->slices != NULL ? input->slices[i].base->num_items : input->num_items;
+    }
+    ranges->last = malloc(sizeof(int) * rdd->partitions_cnt);
+    for (int i = 0; i < rdd->partitions_cnt; i++)
+      ranges->last[i] = -1;
+
+    int *range = malloc(sizeof(int) * (slots + 1));
+    ListIter iter = list_get_iter(input);
+    void *data;
+    while ((data = iter_next(&iter)) != NULL)
+    {
+      void *key = ((KeyFn)rdd->ctx)(data);
+      int slot = ranges->offsets[iter.slice] + iter.index - 1;
+      range[slot] = sort_range(rdd, bounds, bounds_cnt, key);
+      ranges->last[range[slot]] = slot;
+      free(key);
+    }
+    ranges->range = range;
+  }
+  pthread_mutex_unlock(&ranges->lock);
+  return ranges;
+}
+
+/* Whether an earlier task found that a parent partition holds no items of pnum */
+bool sort_skip(RDD *rdd, int ppnum, int pnum)
+{
+  SortRanges *ranges = &rdd->ranges[ppnum];
+  pthread_mutex_lock(&ranges->lock);
+  bool skip = ranges->range != NULL && ranges->last[pnum] < 0;
+  pthread_mutex_unlock(&ranges->lock);
+  return skip;
+}
+
+void sorter_init(Sorter *sorter, KeyFn keyfn, Comparator cmp, RDD *dep, bool owned)
+{
+  sorter->keyfn = keyfn;
+  sorter->cmp = cmp;
+  sorter->serialize = dep->serialize;
+  sorter->deserialize = dep->deserialize;
+  sorter->dep = dep;
+  sorter->owned = owned;
+  pthread_mutex_lock(&memory->lock);
+  sorter->limit = memory->sort_limit;
+  pthread_mutex_unlock(&memory->lock);
+  if (dep->serialize == NULL || dep->deserialize == NULL)
+    sorter->limit = 0;
+  sorter->cap = 64;
+  sorter->entries = malloc(sizeof(SortEntry) * sorter->cap);
+  sorter->cnt = 0;
+  sorter->bytes = 0;
+  sorter->runs = NULL;
+  sorter->runs_cnt = 0;
+}
+
+/* Writes the buffered items as one sorted run */
+void sorter_flush(Sorter *sorter)
+{
+  qsort_r(sorter->entries, sorter->cnt, sizeof(SortEntry), compare_entries, sorter->cmp);
+  FILE *run = spill_open();
+  for (int i = 0; i < sorter->cnt; i++)
+  {
+    if (sorter->serialize(sorter->entries[i].data, run) == 0)
+    {
+      printf("error writing sorted run\n");
+      exit(1);
+    }
+    free(sorter->entries[i].key);
+    if (sorter->owned)
+      free_item(sorter->dep, sorter->entries[i].data);
+  }
+  fflush(run);
+  sorter->runs = realloc(sorter->runs, sizeof(FILE *) * (sorter->runs_cnt + 1));
+  sorter->runs[sorter->runs_cnt++] = run;
+  sorter->cnt = 0;
+  sorter->bytes = 0;
+
+  pthread_mutex_lock(&memory->lock);
+  memory->sort_run_cnt += 1;
+  pthread_mutex_unlock(&memory->lock);
+}
+
+/* Adds an item with its key. Returns true if the buffered items went to a run, after which
+ * the sorter does not refer to any item it was given anymore */
+bool sorter_add(Sorter *sorter, void *key, void *data)
+{
+  if (sorter->cnt == sorter->cap)
+  {
+    sorter->cap *= 2;
+    sorter->entries = realloc(sorter->entries, sizeof(SortEntry) * sorter->cap);
+  }
+  sorter->entries[sorter->cnt].key = key;
+  sorter->entries[sorter->cnt].data = data;
+  sorter->cnt++;
+  if (sorter->limit == 0)
+    return false;
+
+  // Charged the same way blocks are
+  sorter->bytes += sizeof(SortEntry) + malloc_usable_size(key) + malloc_usable_size(data);
+  if (sorter->bytes <= sorter->limit)
+    return false;
+  sorter_flush(sorter);
+  return true;
+}
+
+/* Reads the next item of a run into its head, NULL data at its end */
+void run_next(Sorter *sorter, RunHead *head)
+{
+  free(head->key);
+  head->key = NULL;
+  head->data = NULL;
+  int c = fgetc(head->fp);
+  if (c == EOF)
+    return;
+  ungetc(c, head->fp);
+  if ((head->data = sorter->deserialize(head->fp)) == NULL)
+  {
+    printf("error reading sorted run\n");
+    exit(1);
+  }
+  head->key = sorter->keyfn(head->data);
+}
+
+/* Whether the head of run a comes before the head of run b, ties go to the earlier run */
+bool run_before(Sorter *sorter, RunHead *heads, int a, int b)
+{
+  if (heads[a].data == NULL)
+    return false;
+  if (heads[b].data == NULL)
+    return true;
+  int c = sorter->cmp(heads[a].key, heads[b].key);
+  return c < 0 || (c == 0 && a < b);
+}
+
+/* Plays the matches below node of the loser tree, returns the winner. Nodes 1 .. k - 1 keep
+ * the loser of their match, node k + i stands for run i */
+int merge_play(Sorter *sorter, RunHead *heads, int *tree, int node)
+{
+  int k = sorter->runs_cnt;
+  if (node >= k)
+    return node - k;
+  int a = merge_play(sorter, heads, tree, 2 * node);
+  int b = merge_play(sorter, heads, tree, 2 * node + 1);
+  if (run_before(sorter, heads, a, b))
+  {
+    tree[node] = b;
+    return a;
+  }
+  tree[node] = a;
+  return b;
+}
+
+/* Merges the runs with a loser tree: every item takes one match per level of the tree */
+List *sorter_merge(Sorter *sorter)
+{
+  int k = sorter->runs_cnt;
+  RunHead heads[k];
+  for (int i = 0; i < k; i++)
+  {
+    // Runs are read sequentially, so each gets a large buffer of its own
+    int fd = dup(fileno(sorter->runs[i]));
+    fclose(sorter->runs[i]);
+    heads[i].fp = fdopen(fd, "r");
+    setvbuf(heads[i].fp, NULL, _IOFBF, SORT_READ_BUFFER);
+    rewind(heads[i].fp);
+    heads[i].key = NULL;
+    run_next(sorter, &heads[i]);
+  }
+
+  int tree[k];
+  int winner = merge_play(sorter, heads, tree, 1);
+  List *newpartition = list_init();
+  while (heads[winner].data != NULL)
+  {
+    list_add(newpartition, heads[winner].data);
+    run_next(sorter, &heads[winner]);
+    for (int node = (winner + k) / 2; node > 0; node /= 2)
+    {
+      if (run_before(sorter, heads, tree[node], winner))
+      {
+        int loser = winner;
+        winner = tree[node];
+        tree[node] = loser;
+      }
+    }
+  }
+  for (int i = 0; i < k; i++)
+    fclose(heads[i].fp);
+  return newpartition;
+}
+
+/* Returns the sorted items. Without runs these are the items which were added, otherwise
+ * they are copies read back from the runs */
+List *sorter_finish(Sorter *sorter)
+{
+  List *newpartition;
+  if (sorter->runs_cnt == 0)
+  {
+    qsort_r(sorter->entries, sorter->cnt, sizeof(SortEntry), compare_entries, sorter->cmp);
+    newpartition = list_init();
+    for (int i = 0; i < sorter->cnt; i++)
+    {
+      list_add(newpartition, sorter->entries[i].data);
+      free(sorter->entries[i].key);
+    }
+  }
+  else
+  {
+    if (sorter->cnt > 0)
+      sorter_flush(sorter);
+    newpartition = sorter_merge(sorter);
+  }
+  free(sorter->entries);
+  free(sorter->runs);
+  return newpartition;
+}
+
+/* Throws away the buffered items and runs of a failed sort */
+void sorter_free(Sorter *sorter)
+{
+  for (int i = 0; i < sorter->cnt; i++)
+  {
+    free(sorter->entries[i].key);
+    if (sorter->owned)
+      free_item(sorter->dep, sorter->entries[i].data);
+  }
+  for (int i = 0; i < sorter->runs_cnt; i++)
+    fclose(sorter->runs[i]);
+  free(sorter->entries);
+  free(sorter->runs);
+}
+
+List *sort_partition(RDD *rdd, int pnum, bool fresh, bool *discarded)
+{
+  RDD *dep = rdd->dependencies[0];
+  RDD *sample = rdd->dependencies[1];
+  KeyFn keyfn = (KeyFn)rdd->ctx;
+
+  // A recomputed partition can not rely on the shared boundaries, so it picks its own
+  void **bounds;
+  int bounds_cnt;
+  List *samples[sample->partitions_cnt];
+  if (fresh)
+  {
+    for (int i = 0; i < sample->partitions_cnt; i++)
+    {
+      if ((samples[i] = compute_partition(sample, i, true, NULL)) == NULL)
+      {
+        while (--i >= 0)
+          list_free(samples[i]);
+        return NULL;
+      }
+    }
+    bounds = sort_bounds(rdd, samples, &bounds_cnt);
+  }
+  else
+  {
+    bounds = sort_acquire(rdd, &bounds_cnt);
+  }
+
+  // Select the items of this range, like partitionBy does. Inputs [held, opened) stay open
+  // while the sorter refers to their items, which may not be spilled meanwhile. Shared
+  // inputs are bucketed by range once, tasks start at different inputs to do so in parallel
+  Sorter sorter;
+  sorter_init(&sorter, keyfn, (Comparator)rdd->fn, dep, fresh);
+  List *inputs[dep->partitions_cnt];
+  List *selected = fresh ? NULL : list_view_init();
+  int held = 0;
+  int opened;
+  for (opened = 0; opened < dep->partitions_cnt; opened++)
+  {
+    int ppnum = fresh ? opened : (pnum + opened) % dep->partitions_cnt;
+    inputs[opened] = NULL;
+    if (!fresh && sort_skip(rdd, ppnum, pnum))
+      continue;
+    List *input = open_input(dep, ppnum, fresh);
+    if (input == NULL)
+      break;
+    inputs[opened] = input;
+    int slice = selected != NULL ? list_view_add(selected, input) : 0;
+    SortRanges *ranges = fresh ? NULL : sort_ranges(rdd, bounds, bounds_cnt, ppnum, input);
+    ListIter iter = list_get_iter(input);
+    void *data;
+    while ((data = iter_next(&iter)) != NULL)
+    {
+      void *key;
+      if (ranges != NULL)
+      {
+        // Nothing of this range follows the last slot
+        int slot = ranges->offsets[iter.slice] + iter.index - 1;
+        if (slot > ranges->last[pnum])
+          break;
+        if (ranges->range[slot] != pnum)
+          continue;
+        key = keyfn(data);
+      }
+      else
+      {
+        key = keyfn(data);
+        if (sort_range(rdd, bounds, bounds_cnt, key) != pnum)
+        {
+          free(key);
+          free_item(dep, data); // recomputed copy which belongs to another partition
+          continue;
+        }
+      }
+      if (sorter_add(&sorter, key, data))
+      {
+        // The sorted items are copies in runs now, the inputs are left to their blocks
+        // like the disk shuffle does, and only the current one is still read
+        if (selected != NULL)
+        {
+          list_free(selected);
+          selected = NULL;
+        }
+        for (; held < opened; held++)
+        {
+          if (inputs[held] != NULL)
+            close_input(dep, inputs[held], fresh);
+        }
+      }
+      else if (selected != NULL)
+      {
+        list_view_select(selected, slice + iter.slice, iter.index - 1);
+      }
+    }
+  }
+  bool failed = opened < dep->partitions_cnt;
+  List *newpartition = NULL;
+  if (failed)
+    sorter_free(&sorter);
+  else
+    newpartition = sorter_finish(&sorter);
+
+  if (fresh)
+  {
+    for (; held < opened; held++)
+    {
+      if (inputs[held] != NULL)
+        close_input(dep, inputs[held], fresh);
+    }
+    free(bounds);
+    for (int i = 0; i < sample->partitions_cnt; i++)
+      list_free(samples[i]);
+    return newpartition;
+  }
+
+  // In memory, the sorted partition takes over the selected items of every input. Speculative
+  // copies sort from lineage, so the original settles its partition even when it loses
+  bool keep = !failed && claim_partition(rdd, pnum);
+  if (selected != NULL)
+  {
+    list_view_finish(selected);
+    if (!failed)
+      list_consume(selected);
+    list_free(selected);
+  }
+  for (; held < opened; held++)
+  {
+    if (inputs[held] != NULL)
+      close_input(dep, inputs[held], fresh);
+  }
+  sort_release(rdd, !failed);
+  if (keep)
+    return newpartition;
+  if (failed)
+    return NULL;
+  list_free_items(newpartition, rdd);
+  *discarded = true;
+  return NULL;
+}
+
+// An item offered to a top k heap, with its position in the input
+typedef struct
+{
+  void *data;
+  int slice;
+  int indx;
+} HeapEntry;
+
+// Min-heap of the k greatest items seen so far, the root is the least of them
+typedef struct
+{
+  HeapEntry *entries; // grown on demand, a partition may hold far fewer than k items
+  int cnt;
+  int cap;
+  int k;
+  Comparator cmp;
+} TopHeap;
+
+void heap_swap(TopHeap *heap, int a, int b)
+{
+  HeapEntry tmp = heap->entries[a];
+  heap->entries[a] = heap->entries[b];
+  heap->entries[b] = tmp;
+}
+
+/* Doubles the capacity of a full heap, up to k entries */
+void heap_grow(TopHeap *heap)
+{
+  size_t cap = heap->cap > 0 ? (size_t)heap->cap * 2 : 16;
+  cap = cap < (size_t)heap->k ? cap : (size_t)heap->k;
+  HeapEntry *entries = realloc(heap->entries, sizeof(HeapEntry) * cap);
+  if (entries == NULL)
+  {
+    printf("error: topK of %d elements does not fit in memory\n", heap->k);
+    exit(1);
+  }
+  heap->entries = entries;
+  heap->cap = cap;
+}
+
+/* Adds an item if it is among the k greatest, returns the item that fell out or NULL */
+void *heap_offer(TopHeap *heap, HeapEntry entry)
+{
+  if (heap->cnt < heap->k)
+  {
+    if (heap->cnt == heap->cap)
+      heap_grow(heap);
+    int i = heap->cnt++;
+    heap->entries[i] = entry;
+    while (i > 0 && heap->cmp(heap->entries[i].data, heap->entries[(i - 1) / 2].data) < 0)
+    {
+      heap_swap(heap, i, (i - 1) / 2);
+      i = (i - 1) / 2;
+    }
+    return NULL;
+  }
+  if (heap->k == 0 || heap->cmp(entry.data, heap->entries[0].data) <= 0)
+    return entry.data;
+
+  void *evicted = heap->entries[0].data;
+  heap->entries[0] = entry;
+  int i = 0;
+  while (true)
+  {
+    int least = i;
+    int left = 2 * i + 1;
+    int right = 2 * i + 2;
+    if (left < heap->cnt && heap->cmp(heap->entries[left].data, heap->entries[least].data) < 0)
+      least = left;
+    if (right < heap->cnt && heap->cmp(heap->entries[right].data, heap->entries[least].data) < 0)
+      least = right;
+    if (least == i)
+      break;
+    heap_swap(heap, i, least);
+    i = least;
+  }
+  return evicted;
+}
+
+List *topk_partition(RDD *rdd, int pnum, bool fresh, bool *discarded)
+{
+  // A fused selection recomputes its input, which was never materialized
+  RDD *dep = rdd->dependencies[0];
+  bool owned = fresh || rdd->fused;
+  List *input = open_input(dep, pnum, owned);
+  if (input == NULL)
+    return NULL;
+
+  int k = (long)rdd->ctx;
+  TopHeap heap = {NULL, 0, 0, k, (Comparator)rdd->fn};
+  ListIter iter = list_get_iter(input);
+  void *data;
+  while ((data = iter_next(&iter)) != NULL)
+  {
+    HeapEntry entry = {data, iter.slice, iter.index - 1};
+    void *rejected = heap_offer(&heap, entry);
+    if (owned && rejected != NULL)
+      free_item(dep, rejected); // recomputed copy which is not among the k greatest
+  }
+
+  // Recomputed items are copied, otherwise the partition is a view selecting the k
+  // greatest of the input, which stays untouched like it does for print
+  List *newpartition = owned ? list_init() : list_view_init();
+  if (!owned)
+    list_view_add(newpartition, input);
+  for (int i = 0; i < heap.cnt; i++)
+  {
+    if (owned)
+      list_add(newpartition, heap.entries[i].data);
+    else
+      list_view_select(newpartition, heap.entries[i].slice, heap.entries[i].indx);
+  }
+  free(heap.entries);
+  if (!owned)
+    list_view_finish(newpartition);
+  close_input(dep, input, owned);
+  if (fresh || claim_partition(rdd, pnum))
+    return newpartition;
+
+  // The input stays untouched, so only the selection (or the recomputed copies) is dropped
+  list_free_items(newpartition, dep);
+  *discarded = true;
+  return NULL;
+}
+
+/* True if every partition can be recomputed from lineage on its own, without reading all
+ * partitions of a wide dependency */
+bool narrow_lineage(RDD *rdd)
+{
+  if (rdd->trans == FILE_BACKED)
+    return true;
+  if (rdd->trans != MAP && rdd->trans != FILTER && rdd->trans != FLATMAP &&
+      rdd->trans != MAPPARTITIONS && rdd->trans != UNION && rdd->trans != COALESCE)
+    return false;
+  for (int i = 0; i < rdd->dependencies_cnt; i++)
+  {
+    if (!narrow_lineage(rdd->dependencies[i]))
+      return false;
+  }
+  return true;
+}
+
+int compare_descending(const void *a, const void *b, void *cmp)
+{
+  return ((Comparator)cmp)(*(void **)b, *(void **)a);
+}
+
+void topK(RDD *rdd, int k, Comparator cmp, Printer p)
+{
+  if (k < 0)
+  {
+    printf("error: topK of %d elements\n", k);
+    exit(1);
+  }
+
+  // The partial results are selected by a stage of their own, in parallel. Unless rdd is
+  // materialized already, the stage computes its partitions over narrow lineage itself, so
+  // only k items per partition are kept instead of all of rdd
+  RDD *partials = create_rdd(1, TOPK, cmp, rdd);
+  alloc_partitions(partials, rdd->partitions_cnt);
+  partials->ctx = (void *)(long)k;
+  pthread_mutex_lock(&rdd->lock);
+  bool materialized = rdd->materialized_cnt == rdd->partitions_cnt;
+  pthread_mutex_unlock(&rdd->lock);
+  partials->fused = !materialized && narrow_lineage(rdd);
+  execute(partials);
+
+  TopHeap heap = {NULL, 0, 0, k, cmp};
+  for (int i = 0; i < partials->partitions_cnt; i++)
+  {
+    list_pin(partials->partitions[i]);
+    ListIter iter = list_get_iter(partials->partitions[i]);
+    void *data;
+    while ((data = iter_next(&iter)) != NULL)
+    {
+      HeapEntry entry = {data, 0, 0};
+      heap_offer(&heap, entry);
+    }
+  }
+
+  // As many results as k allows, too many for the stack
+  void **top = malloc(sizeof(void *) * ((size_t)heap.cnt + 1));
+  if (top == NULL)
+  {
+    printf("error: topK of %d elements does not fit in memory\n", k);
+    exit(1);
+  }
+  for (int i = 0; i < heap.cnt; i++)
+    top[i] = heap.entries[i].data;
+  qsort_r(top, heap.cnt, sizeof(void *), compare_descending, cmp);
+  for (int i = 0; i < heap.cnt; i++)
+    p(top[i]);
+  free(top);
+  free(heap.entries);
+
+  for (int i = 0; i < partials->partitions_cnt; i++)
+    list_unpin(partials->partitions[i]);
+}
@@ -0,0 +1,437 @@
+#define _GNU_SOURCE
+#include <malloc.h>
+#include <limits.h>
+#include "minispark.h"
+
+MemoryManager *memory;
+
+void memory_init()
+{
+  memory = malloc(sizeof(MemoryManager));
+  pthread_mutex_init(&memory->lock, NULL);
+  memory->budget = 0;
+  memory->used = 0;
+  memory->blocks = list_init();
+  memory->clock = 0;
+  char *tmpdir = getenv("TMPDIR");
+  memory->dir = strdup(tmpdir != NULL ? tmpdir : "/tmp");
+  pthread_cond_init(&memory->rebuilt, NULL);
+  memory->spill_cnt = 0;
+  memory->load_cnt = 0;
+  memory->recompute_cnt = 0;
+  memory->join_limit = 0;
+  memory->join_spill_cnt = 0;
+  memory->sort_limit = 0;
+  memory->sort_run_cnt = 0;
+}
+
+void memory_destroy()
+{
+  ListIter iter = list_get_iter(memory->blocks);
+  Block *block;
+  while ((block = iter_next(&iter)) != NULL)
+  {
+    if (block->spill != NULL)
+      fclose(block->spill);
+    free(block->consumed);
+    block->list->block = NULL;
+  }
+  list_free(memory->blocks);
+  pthread_mutex_destroy(&memory->lock);
+  pthread_cond_destroy(&memory->rebuilt);
+  free(memory->dir);
+  free(memory);
+}
+
+void MS_SetMemoryBudget(size_t bytes)
+{
+  pthread_mutex_lock(&memory->lock);
+  memory->budget = bytes;
+  pthread_mutex_unlock(&memory->lock);
+}
+
+void MS_SetSpillDir(char *dir)
+{
+  pthread_mutex_lock(&memory->lock);
+  free(memory->dir);
+  memory->dir = strdup(dir);
+  pthread_mutex_unlock(&memory->lock);
+}
+
+int MS_SpillCount()
+{
+  pthread_mutex_lock(&memory->lock);
+  int cnt = memory->spill_cnt;
+  pthread_mutex_unlock(&memory->lock);
+  return cnt;
+}
+
+int MS_RecomputeCount()
+{
+  pthread_mutex_lock(&memory->lock);
+  int cnt = memory->recompute_cnt;
+  pthread_mutex_unlock(&memory->lock);
+  return cnt;
+}
+
+RDD* withSerde(RDD* rdd, Serializer ser, Deserializer de, Freer fr)
+{
+  rdd->serialize = ser;
+  rdd->deserialize = de;
+  rdd->freer = fr;
+  return rdd;
+}
+
+bool is_consumed(Block *block, int indx)
+{
+  return block->consumed[indx / 8] & (1 << (indx % 8));
+}
+
+/* Memory charged to the block, only items which were not consumed count */
+size_t block_charge(Block *block)
+{
+  return block->resident ? block->item_bytes * block->live : 0;
+}
+
+/* Opens an anonymous spill file which disappears once it is closed */
+FILE *spill_open()
+{
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/minispark-spill-XXXXXX", memory->dir);
+  int fd = mkstemp(path);
+  if (fd < 0)
+  {
+    perror("mkstemp");
+    exit(1);
+  }
+  unlink(path);
+  return fdopen(fd, "w+");
+}
+
+/* FNV-1a hash of the whole spill file */
+unsigned long spill_checksum(FILE *spill)
+{
+  unsigned long hash = 14695981039346656037UL;
+  rewind(spill);
+  int c;
+  while ((c = fgetc(spill)) != EOF)
+  {
+    hash ^= (unsigned char)c;
+    hash *= 1099511628211UL;
+  }
+  return hash;
+}
+
+bool can_spill(Block *block)
+{
+  return block->owner->serialize != NULL && block->owner->deserialize != NULL;
+}
+
+/* Writes the live items to the spill file (once) and frees them. Without a serializer the
+ * items are only freed and the block has to be recomputed. Called with the lock held */
+void block_spill(Block *block)
+{
+  List *list = block->list;
+  RDD *owner = block->owner;
+  bool write = block->spill == NULL && can_spill(block);
+  if (write)
+    block->spill = spill_open();
+
+  // Every slot is prefixed with a flag so that item indices survive the round trip
+  int indx = 0;
+  ListNode *node = list->head;
+  while (node != NULL)
+  {
+    bool live = node->data != NULL && !is_consumed(block, indx);
+    if (write)
+    {
+      fputc(live, block->spill);
+      if (live && owner->serialize(node->data, block->spill) == 0)
+      {
+        printf("error spilling partition of RDD %p\n", (void *)owner);
+        exit(1);
+      }
+    }
+    if (live)
+      free_item(owner, node->data);
+
+    ListNode *next = node->next;
+    free(node);
+    node = next;
+    indx++;
+  }
+  if (write)
+  {
+    fflush(block->spill);
+    block->checksum = spill_checksum(block->spill);
+  }
+
+  memory->used -= block_charge(block);
+  list->head = NULL;
+  list->tail = NULL;
+  block->resident = false;
+  if (block->spill != NULL)
+    memory->spill_cnt += 1;
+}
+
+/* Installs the nodes of a loaded or recomputed block, items consumed in the meantime are dropped */
+void block_install(Block *block, ListNode *head, ListNode *tail)
+{
+  int indx = 0;
+  for (ListNode *node = head; node != NULL; node = node->next, indx++)
+  {
+    // Consumed slots keep a NULL item, which iterators skip
+    if (node->data != NULL && is_consumed(block, indx))
+    {
+      free_item(block->owner, node->data);
+      node->data = NULL;
+    }
+  }
+  block->list->head = head;
+  block->list->tail = tail;
+  block->resident = true;
+  memory->used += block_charge(block);
+}
+
+/* Reads a spilled block back. Returns false if the spill file is damaged. Called with the lock held */
+bool block_load(Block *block)
+{
+  List *list = block->list;
+  RDD *owner = block->owner;
+  if (spill_checksum(block->spill) != block->checksum)
+    return false;
+  rewind(block->spill);
+
+  ListNode *head = NULL;
+  ListNode *tail = NULL;
+  for (int indx = 0; indx < list->num_items; indx++)
+  {
+    int flag = fgetc(block->spill);
+    void *data = NULL;
+    if (flag == EOF || (flag == 1 && (data = owner->deserialize(block->spill)) == NULL))
+    {
+      while (head != NULL)
+      {
+        ListNode *next = head->next;
+        if (head->data != NULL)
+          free_item(owner, head->data);
+        free(head);
+        head = next;
+      }
+      return false;
+    }
+
+    ListNode *node = malloc(sizeof(ListNode));
+    node->data = data;
+    node->next = NULL;
+    if (head == NULL)
+      head = node;
+    else
+      tail->next = node;
+    tail = node;
+  }
+
+  block_install(block, head, tail);
+  memory->load_cnt += 1;
+  return true;
+}
+
+/* Recomputes a lost block from the lineage of its RDD. The lock is released meanwhile,
+ * the caller holds a pin so the block can not go away. Called with the lock held */
+void block_rebuild(Block *block)
+{
+  block->rebuilding = true;
+  pthread_mutex_unlock(&memory->lock);
+  List *fresh = compute_partition(block->owner, block->pnum, true, NULL);
+  pthread_mutex_lock(&memory->lock);
+
+  if (fresh == NULL || fresh->num_items != block->list->num_items)
+  {
+    printf("error recomputing partition %d of RDD %p\n", block->pnum, (void *)block->owner);
+    exit(1);
+  }
+  block_install(block, fresh->head, fresh->tail);
+  free(fresh);
+  block->rebuilding = false;
+  memory->recompute_cnt += 1;
+  pthread_cond_broadcast(&memory->rebuilt);
+}
+
+/* Spills least recently used blocks until the budget is met. Called with the lock held */
+void memory_reclaim()
+{
+  while (memory->budget > 0 && memory->used > memory->budget)
+  {
+    Block *victim = NULL;
+    ListIter iter = list_get_iter(memory->blocks);
+    Block *block;
+    while ((block = iter_next(&iter)) != NULL)
+    {
+      if (!block->resident || block->pins > 0 || block->live == 0)
+        continue;
+      if (victim == NULL || block->last_used < victim->last_used)
+        victim = block;
+    }
+    if (victim == NULL)
+      return;
+    block_spill(victim);
+  }
+}
+
+/* Stops managing a block once all of its items were handed over. Called with the lock held */
+void block_retire(Block *block)
+{
+  memory->used -= block_charge(block);
+  if (block->spill != NULL)
+    fclose(block->spill);
+  list_remove(memory->blocks, block);
+  block->list->block = NULL;
+  free(block->consumed);
+  free(block);
+}
+
+void block_register(List *list, RDD *owner, int pnum)
+{
+  // Views are covered by the blocks of their bases
+  if (memory->budget == 0 || list->slices != NULL || list->num_items == 0)
+    return;
+
+  // Estimate the footprint from the allocator's view of every item
+  size_t bytes = 0;
+  ListNode *node;
+  for (node = list->head; node != NULL; node = node->next)
+    bytes += sizeof(ListNode) + malloc_usable_size(node->data);
+
+  Block *block = malloc(sizeof(Block));
+  block->list = list;
+  block->owner = owner;
+  block->pnum = pnum;
+  block->spill = NULL;
+  block->checksum = 0;
+  block->resident = true;
+  block->rebuilding = false;
+  block->pins = 0;
+  block->item_bytes = bytes / list->num_items;
+  block->live = list->num_items;
+  block->consumed = calloc((list->num_items + 7) / 8, 1);
+
+  pthread_mutex_lock(&memory->lock);
+  list->block = block;
+  block->last_used = ++memory->clock;
+  list_add(memory->blocks, block);
+  memory->used += block_charge(block);
+  memory_reclaim();
+  pthread_mutex_unlock(&memory->lock);
+}
+
+/* Applies fn to the block behind a concrete list or behind every slice of a view */
+void for_each_block(List *list, void (*fn)(Block *block, ListSlice *slice))
+{
+  if (list->slices == NULL)
+  {
+    if (list->block != NULL)
+      fn(list->block, NULL);
+    return;
+  }
+  for (int i = 0; i < list->slices_cnt; i++)
+  {
+    if (list->slices[i].base->block != NULL)
+      fn(list->slices[i].base->block, &list->slices[i]);
+  }
+}
+
+void pin_block(Block *block, ListSlice *slice)
+{
+  (void)slice;
+  block->pins += 1;
+  while (!block->resident)
+  {
+    if (block->rebuilding)
+    {
+      pthread_cond_wait(&memory->rebuilt, &memory->lock);
+      continue;
+    }
+    if (block->spill != NULL && block_load(block))
+      break;
+
+    // Dropped, or the spill file went bad; it is rewritten on the next spill
+    if (block->spill != NULL)
+    {
+      fclose(block->spill);
+      block->spill = NULL;
+    }
+    block_rebuild(block);
+  }
+}
+
+void unpin_block(Block *block, ListSlice *slice)
+{
+  (void)slice;
+  block->pins -= 1;
+  block->last_used = ++memory->clock;
+  if (block->live == 0 && block->pins == 0)
+    block_retire(block);
+}
+
+void list_pin(List *list)
+{
+  pthread_mutex_lock(&memory->lock);
+  for_each_block(list, pin_block);
+  pthread_mutex_unlock(&memory->lock);
+}
+
+void list_unpin(List *list)
+{
+  pthread_mutex_lock(&memory->lock);
+  for_each_block(list, unpin_block);
+  memory_reclaim();
+  pthread_mutex_unlock(&memory->lock);
+}
+
+/* Marks items selected by bitmap (or all of them), except those set in keep */
+void consume_items(Block *block, unsigned char *bitmap, unsigned char *keep)
+{
+  size_t before = block_charge(block);
+  for (int i = 0; i < block->list->num_items; i++)
+  {
+    unsigned char bit = 1 << (i % 8);
+    if (bitmap != NULL && !(bitmap[i / 8] & bit))
+      continue;
+    if (keep != NULL && (keep[i / 8] & bit))
+      continue;
+    if (block->consumed[i / 8] & bit)
+      continue;
+    block->consumed[i / 8] |= bit;
+    block->live -= 1;
+  }
+  memory->used -= before - block_charge(block);
+
+  if (block->live == 0 && block->pins == 0)
+    block_retire(block);
+}
+
+void consume_block(Block *block, ListSlice *slice)
+{
+  consume_items(block, slice != NULL ? slice->bitmap : NULL, NULL);
+}
+
+void list_consume(List *list)
+{
+  pthread_mutex_lock(&memory->lock);
+  for_each_block(list, consume_block);
+  pthread_mutex_unlock(&memory->lock);
+}
+
+void list_consume_except(List *list, List *kept)
+{
+  pthread_mutex_lock(&memory->lock);
+  for (int i = 0; i < kept->slices_cnt; i++)
+  {
+    Block *block = kept->slices[i].base->block;
+    if (block == NULL)
+      continue;
+    unsigned char *bitmap = list->slices != NULL ? list->slices[i].bitmap : NULL;
+    consume_items(block, bitmap, kept->slices[i].bitmap);
+  }
+  pthread_mutex_unlock(&memory->lock);
+}
@@ -4,7 +4,7 @@ import re
 def check_line(line: str):
     regex = (
         r'^RDD\s+0x[0-9a-fA-F]+\s+Part\s+\d+\s+Trans\s+(\d+)\s+--\s+creation\s+'
-        r'\s*\d+\.\d{6},\s+scheduled\s+\s*\d+\.\d{6},\s+execution\s+\(usec\)\s+\d+\s*$'
+        r'\s*\d+\.\d{6},\s+scheduled\s+\s*\d+\.\d{6},\s+execution\s+\(usec\)\s+\d+,\s+items\s+\d+\s*$'
     )
     match = re.match(regex, line)
     if match:
@@ -12,12 +12,20 @@ def check_line(line: str):
         return True, trans_value
     else:
         return False, 0
+def check_job_line(line: str):
+    regex = (
+        r'^Job\s+\d+\s+Pool\s+\S+\s+--\s+submitted\s+\s*\d+\.\d{6},\s+tasks\s+\d+,\s+'
+        r'queue wait\s+\(usec\)\s+avg\s+\d+\s+max\s+\d+,\s+execution\s+\(usec\)\s+\d+\s*$'
+    )
+    return re.match(regex, line) is not None
 def check():
     f = open('metrics.log')
     cnt = [0,0,0,0,0]
     ans = [32, 0, 64, 2, 0]
 
     for line in f:
+        if check_job_line(line):
+            continue
         r, t = check_line(line)
         if not r:
             print("log format mismatch")
@@ -0,0 +1,63 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "lib.h"
+#include "minispark.h"
+
+#define NUMFILES 512
+#define FILENAMESIZE 100
+
+char *filenames[NUMFILES];
+char *smallfiles[] = {"./test_files/one.txt", "./test_files/two.txt", "./test_files/three.txt"};
+SchedPool *batch;
+SchedPool *interactive;
+int scanned;
+int matched;
+
+void *batch_job(void *arg) {
+  (void)arg;
+  MS_SetPool(batch);
+  RDD* files = RDDFromFiles(filenames, NUMFILES);
+  scanned = count(map(files, GetLines));
+  return NULL;
+}
+
+void *interactive_job(void *arg) {
+  (void)arg;
+  MS_SetPool(interactive);
+  RDD* files = RDDFromFiles(smallfiles, 3);
+  matched = count(filter(map(files, GetLines), StringContains, "one"));
+  return NULL;
+}
+
+int main() {
+  for (int i = 0; i < NUMFILES; i++) {
+    filenames[i] = calloc(FILENAMESIZE, 1);
+    sprintf(filenames[i], "./test_files/largevals%d.txt", i);
+  }
+
+  MS_Run();
+  MS_SetSchedulingMode(POOL_FAIR);
+  batch = MS_CreatePool("batch", POOL_FIFO, 1, 0);
+  interactive = MS_CreatePool("interactive", POOL_FAIR, 2, 1);
+
+  pthread_t threads[2];
+  pthread_create(&threads[0], NULL, batch_job, NULL);
+  pthread_create(&threads[1], NULL, interactive_job, NULL);
+  pthread_join(threads[0], NULL);
+  pthread_join(threads[1], NULL);
+
+  MS_TearDown();
+  printf("scanned %d lines, matched %d lines\n", scanned, matched);
+
+  for (int i = 0; i < NUMFILES; i++) {
+    free(filenames[i]);
+  }
+
+  int num_threads = getNumThreads();
+  if (num_threads > 1) {
+    printf("Worker threads didn't terminate\n");
+    return 0;
+  }
+  return 0;
+}
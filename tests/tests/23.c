@@ -0,0 +1,58 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lib.h"
+#include "minispark.h"
+
+#define NUMFILES 32
+#define FILENAMESIZE 100
+
+// keeps rows whose key ends with the digit given in ctx
+int KeyEndsWith(void* arg, void* ctx) {
+  struct row* row = (struct row*)arg;
+  char* key = row->cols[0];
+  return key[strlen(key) - 1] == *(char*)ctx;
+}
+
+// keeps rows whose value is even
+int EvenValue(void* arg, void* ctx) {
+  (void)ctx;
+  struct row* row = (struct row*)arg;
+  return atoi(row->cols[1]) % 2 == 0;
+}
+
+int main() {
+  char *filenames[NUMFILES];
+  for (int i = 0; i < NUMFILES; i++) {
+    filenames[i] = calloc(FILENAMESIZE, 1);
+    sprintf(filenames[i], "./test_files/largevals%d.txt", i);
+  }
+
+  struct colpart_ctx pctx;
+  pctx.keynum = 0;
+  char digit = '7';
+
+  MS_Run();
+
+  RDD* rows = map(map(RDDFromFiles(filenames, NUMFILES), GetLines), SplitCols);
+  RDD* selected = filter(rows, KeyEndsWith, &digit);
+  RDD* repart = partitionBy(selected, ColumnHashPartitioner, 8, &pctx);
+  RDD* even = filter(repart, EvenValue, NULL);
+
+  printf("selected %d\n", count(selected));
+  printf("repartitioned %d\n", count(repart));
+  printf("even %d\n", count(even));
+
+  MS_TearDown();
+
+  for (int i = 0; i < NUMFILES; i++) {
+    free(filenames[i]);
+  }
+
+  int num_threads = getNumThreads();
+  if (num_threads > 1) {
+    printf("Worker threads didn't terminate\n");
+    return 0;
+  }
+  return 0;
+}
@@ -0,0 +1,58 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include "lib.h"
+#include "minispark.h"
+
+#define ROUNDS 5
+#define NUMFILES (1<<ROUNDS)
+#define FILENAMESIZE 100
+#define BUDGET (64 * 1024)
+
+int main() {
+
+  char *filenames[NUMFILES];
+  RDD* files[2];
+
+  struct colpart_ctx pctx;
+  pctx.keynum = 0;
+
+  struct sumjoin_ctx sctx;
+  sctx.keynum = 0;
+  sctx.target = 1;
+
+  // the two halves come from independently shuffled key sets, so some keys match
+  for (int i=0; i< NUMFILES; i++) {
+    filenames[i] = calloc(FILENAMESIZE,1);
+    sprintf(filenames[i], "./test_files/largevals%d.txt", i < NUMFILES/2 ? i : 512 + i - NUMFILES/2);
+  }
+
+  MS_Run();
+  MS_SetMemoryBudget(BUDGET);
+
+  for (int i=0; i< 2; i++) {
+    RDD* rows = withSerde(map(map(RDDFromFiles(filenames + i*NUMFILES/2, NUMFILES/2), GetLines), SplitCols),
+                          RowSerialize, RowDeserialize, NULL);
+    files[i] = partitionBy(rows, ColumnHashPartitioner, 64, &pctx);
+  }
+  RDD* joined = withSerde(join(files[0], files[1], SumJoin, &sctx), RowSerialize, RowDeserialize, NULL);
+
+  // materialize first so that the printed rows must be read back from spill files
+  count(joined);
+  if (MS_SpillCount() == 0) {
+    printf("nothing was spilled with a budget of %d bytes\n", BUDGET);
+  }
+  print(joined, RowPrinter);
+
+  MS_TearDown();
+  for (int i=0; i< NUMFILES; i++) {
+    free(filenames[i]);
+  }
+
+  int num_threads = getNumThreads();
+  if (num_threads > 1) {
+    printf("Worker threads didn't terminate\n");
+    return 0;
+  }
+  return 0;
+}
@@ -0,0 +1,65 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sched.h>
+#include "lib.h"
+#include "minispark.h"
+
+#define NUMFILES 16
+
+// deterministic and side effect free, so a speculative copy computes the same partition
+int SlowFilter(void *arg, void *ctx) {
+  (void)arg;
+  (void)ctx;
+  usleep(200);
+  return 1;
+}
+
+void *Same(void *arg) {
+  return arg;
+}
+
+int main() {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) == -1) {
+    perror("sched_getaffinity");
+    exit(1);
+  }
+  int cpu_cnt = CPU_COUNT(&set);
+
+  // every partition holds a few lines except the last one, which straggles with 1024
+  char *filenames[NUMFILES];
+  for (int i=0; i< NUMFILES; i++) {
+    filenames[i] = calloc(100,1);
+    if (i < NUMFILES - 1)
+      sprintf(filenames[i], "./test_files/%d", i);
+    else
+      sprintf(filenames[i], "./test_files/largevals0.txt");
+  }
+
+  MS_Run();
+  MS_SetSpeculation(1.5);
+
+  RDD* lines = filter(map(RDDFromFiles(filenames, NUMFILES), GetLines), SlowFilter, NULL);
+  printf("lines %d\n", count(lines));
+  printf("lines again %d\n", count(map(lines, Same)));
+
+  // a copy needs an idle worker while the straggler is running
+  if (cpu_cnt > 1 && MS_SpeculatedCount() == 0) {
+    printf("no speculative copy of the straggling partition with %d cpus\n", cpu_cnt);
+  }
+
+  MS_TearDown();
+  for (int i=0; i< NUMFILES; i++) {
+    free(filenames[i]);
+  }
+
+  int num_threads = getNumThreads();
+  if (num_threads > 1) {
+    printf("Worker threads didn't terminate\n");
+    return 0;
+  }
+  return 0;
+}
@@ -0,0 +1,75 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include "lib.h"
+#include "minispark.h"
+
+#define ROUNDS 5
+#define NUMFILES (1<<ROUNDS)
+#define FILENAMESIZE 100
+#define EXECUTORS 3
+#define MARKER "./crash-once.marker"
+
+// kills the task which first sees the marker, the retry finds it gone
+void* CrashOnceSplitCols(void* arg) {
+  if (unlink(MARKER) == 0) {
+    kill(getpid(), SIGKILL);
+  }
+  return SplitCols(arg);
+}
+
+int main() {
+
+  char *filenames[NUMFILES];
+  RDD* files[2];
+
+  struct colpart_ctx pctx;
+  pctx.keynum = 0;
+
+  struct sumjoin_ctx sctx;
+  sctx.keynum = 0;
+  sctx.target = 1;
+
+  // the two halves come from independently shuffled key sets, so some keys match
+  for (int i=0; i< NUMFILES; i++) {
+    filenames[i] = calloc(FILENAMESIZE,1);
+    sprintf(filenames[i], "./test_files/largevals%d.txt", i < NUMFILES/2 ? i : 512 + i - NUMFILES/2);
+  }
+
+  FILE *marker = fopen(MARKER, "w");
+  if (marker == NULL) {
+    perror("fopen");
+    exit(1);
+  }
+  fclose(marker);
+
+  MS_RunCluster(EXECUTORS);
+
+  for (int i=0; i< 2; i++) {
+    RDD* lines = withSerde(map(RDDFromFiles(filenames + i*NUMFILES/2, NUMFILES/2), GetLines),
+                           StringSerialize, StringDeserialize, NULL);
+    RDD* rows = withSerde(map(lines, CrashOnceSplitCols), RowSerialize, RowDeserialize, NULL);
+    files[i] = partitionBy(rows, ColumnHashPartitioner, 64, &pctx);
+  }
+  RDD* joined = withSerde(join(files[0], files[1], SumJoin, &sctx), RowSerialize, RowDeserialize, NULL);
+
+  // every task runs in an executor, including the one which gets killed and retried
+  print(joined, RowPrinter);
+  if (access(MARKER, F_OK) == 0) {
+    printf("no task crashed\n");
+  }
+
+  MS_TearDown();
+  for (int i=0; i< NUMFILES; i++) {
+    free(filenames[i]);
+  }
+
+  int num_threads = getNumThreads();
+  if (num_threads > 1) {
+    printf("Worker threads didn't terminate\n");
+    return 0;
+  }
+  return 0;
+}
@@ -0,0 +1,56 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include "lib.h"
+#include "minispark.h"
+
+#define ROUNDS 5
+#define NUMFILES (1<<ROUNDS)
+#define FILENAMESIZE 100
+
+int main() {
+
+  char *filenames[NUMFILES];
+  RDD* files[2];
+
+  struct colpart_ctx pctx;
+  pctx.keynum = 0;
+
+  struct sumjoin_ctx sctx;
+  sctx.keynum = 0;
+  sctx.target = 1;
+
+  // the two halves come from independently shuffled key sets, so some keys match
+  for (int i=0; i< NUMFILES; i++) {
+    filenames[i] = calloc(FILENAMESIZE,1);
+    sprintf(filenames[i], "./test_files/largevals%d.txt", i < NUMFILES/2 ? i : 512 + i - NUMFILES/2);
+  }
+
+  MS_Run();
+  MS_SetDiskShuffle(true);
+
+  for (int i=0; i< 2; i++) {
+    RDD* rows = withSerde(map(map(RDDFromFiles(filenames + i*NUMFILES/2, NUMFILES/2), GetLines), SplitCols),
+                          RowSerialize, RowDeserialize, NULL);
+    files[i] = partitionBy(rows, ColumnHashPartitioner, 64, &pctx);
+  }
+  RDD* joined = withSerde(join(files[0], files[1], SumJoin, &sctx), RowSerialize, RowDeserialize, NULL);
+
+  // each side shuffles through one file per input partition
+  print(joined, RowPrinter);
+  if (MS_ShuffleFileCount() != NUMFILES) {
+    printf("expected %d shuffle files, got %d\n", NUMFILES, MS_ShuffleFileCount());
+  }
+
+  MS_TearDown();
+  for (int i=0; i< NUMFILES; i++) {
+    free(filenames[i]);
+  }
+
+  int num_threads = getNumThreads();
+  if (num_threads > 1) {
+    printf("Worker threads didn't terminate\n");
+    return 0;
+  }
+  return 0;
+}
@@ -0,0 +1,63 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include "lib.h"
+#include "minispark.h"
+
+#define ROUNDS 5
+#define NUMFILES (1<<ROUNDS)
+#define FILENAMESIZE 100
+#define JOIN_MEMORY (8 * 1024)
+
+int main() {
+
+  char *filenames[NUMFILES];
+  RDD* files[2];
+
+  struct colpart_ctx pctx;
+  pctx.keynum = 0;
+
+  struct sumjoin_ctx sctx;
+  sctx.keynum = 0;
+  sctx.target = 1;
+
+  // the two halves come from independently shuffled key sets, so some keys match
+  for (int i=0; i< NUMFILES; i++) {
+    filenames[i] = calloc(FILENAMESIZE,1);
+    sprintf(filenames[i], "./test_files/largevals%d.txt", i < NUMFILES/2 ? i : 512 + i - NUMFILES/2);
+  }
+
+  MS_Run();
+
+  for (int i=0; i< 2; i++) {
+    RDD* rows = withSerde(map(map(RDDFromFiles(filenames + i*NUMFILES/2, NUMFILES/2), GetLines), SplitCols),
+                          RowSerialize, RowDeserialize, NULL);
+    files[i] = partitionBy(rows, ColumnHashPartitioner, 64, &pctx);
+  }
+  JoinKey key = {RowKeyHash, RowKeyEquals, &pctx};
+
+  // the tables of the first join fit in memory
+  printf("joined rows %d\n", count(hashJoin(files[0], files[1], &key, SumJoin, &sctx)));
+  if (MS_JoinSpillCount() != 0) {
+    printf("join without a memory limit spilled\n");
+  }
+
+  // the second one has to write its buckets to disk
+  MS_SetJoinMemory(JOIN_MEMORY);
+  print(hashJoin(files[0], files[1], &key, SumJoin, &sctx), RowPrinter);
+  if (MS_JoinSpillCount() == 0) {
+    printf("nothing was spilled with a join memory of %d bytes\n", JOIN_MEMORY);
+  }
+
+  MS_TearDown();
+  for (int i=0; i< NUMFILES; i++) {
+    free(filenames[i]);
+  }
+
+  int num_threads = getNumThreads();
+  if (num_threads > 1) {
+    printf("Worker threads didn't terminate\n");
+    return 0;
+  }
+  return 0;
+}
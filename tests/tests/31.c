@@ -0,0 +1,62 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lib.h"
+#include "minispark.h"
+
+#define NUMFILES 8
+#define FILENAMESIZE 100
+#define BUDGET (64 * 1024)
+
+// rows are ordered by their numeric columns, so that ties are broken deterministically
+void* RowKey(void* arg) {
+  struct row* key = malloc(sizeof(struct row));
+  memcpy(key, arg, sizeof(struct row));
+  return key;
+}
+
+int RowCompare(void* key1, void* key2) {
+  struct row* row1 = key1;
+  struct row* row2 = key2;
+  for (int i = 0; i < row1->ncols && i < row2->ncols; i++) {
+    long a = atol(row1->cols[i]);
+    long b = atol(row2->cols[i]);
+    if (a != b) {
+      return a < b ? -1 : 1;
+    }
+  }
+  return row1->ncols - row2->ncols;
+}
+
+int main() {
+
+  char *filenames[NUMFILES];
+  for (int i=0; i< NUMFILES; i++) {
+    filenames[i] = calloc(FILENAMESIZE,1);
+    sprintf(filenames[i], "./test_files/largevals%d.txt", i);
+  }
+
+  MS_Run();
+  MS_SetMemoryBudget(BUDGET);
+
+  RDD* rows = withSerde(map(map(RDDFromFiles(filenames, NUMFILES), GetLines), SplitCols),
+                        RowSerialize, RowDeserialize, NULL);
+  RDD* sorted = sortBy(rows, RowKey, RowCompare, 4);
+
+  // partitions are printed in order, so the output must come out sorted as a whole
+  printf("sorted rows %d\n", count(sorted));
+  print(sorted, RowPrinter);
+
+  MS_TearDown();
+  for (int i=0; i< NUMFILES; i++) {
+    free(filenames[i]);
+  }
+
+  int num_threads = getNumThreads();
+  if (num_threads > 1) {
+    printf("Worker threads didn't terminate\n");
+    return 0;
+  }
+  return 0;
+}
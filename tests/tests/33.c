@@ -0,0 +1,56 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lib.h"
+#include "minispark.h"
+
+#define NUMFILES 16
+#define FILENAMESIZE 100
+#define BUDGET (64 * 1024)
+#define K 20
+
+// rows are ordered by value, then by key
+int ValueCompare(void* arg1, void* arg2) {
+  struct row* row1 = arg1;
+  struct row* row2 = arg2;
+  long a = atol(row1->cols[1]);
+  long b = atol(row2->cols[1]);
+  if (a != b) {
+    return a < b ? -1 : 1;
+  }
+  a = atol(row1->cols[0]);
+  b = atol(row2->cols[0]);
+  return a < b ? -1 : a > b;
+}
+
+int main() {
+
+  char *filenames[NUMFILES];
+  for (int i=0; i< NUMFILES; i++) {
+    filenames[i] = calloc(FILENAMESIZE,1);
+    sprintf(filenames[i], "./test_files/largevals%d.txt", i);
+  }
+
+  MS_Run();
+  MS_SetMemoryBudget(BUDGET);
+
+  RDD* rows = withSerde(map(map(RDDFromFiles(filenames, NUMFILES), GetLines), SplitCols),
+                        RowSerialize, RowDeserialize, NULL);
+
+  // the rows are only selected, so they can still be counted afterwards
+  topK(rows, K, ValueCompare, RowPrinter);
+  printf("rows %d\n", count(rows));
+
+  MS_TearDown();
+  for (int i=0; i< NUMFILES; i++) {
+    free(filenames[i]);
+  }
+
+  int num_threads = getNumThreads();
+  if (num_threads > 1) {
+    printf("Worker threads didn't terminate\n");
+    return 0;
+  }
+  return 0;
+}
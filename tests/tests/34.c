@@ -0,0 +1,51 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include "lib.h"
+#include "minispark.h"
+
+#define NUMFILES 40
+#define FILENAMESIZE 100
+#define BUDGET (64 * 1024)
+
+int main() {
+
+  char *filenames[NUMFILES];
+
+  struct colpart_ctx pctx;
+  pctx.keynum = 0;
+  JoinKey key = {RowKeyHash, RowKeyEquals, &pctx};
+
+  // two independently shuffled key sets, and some files twice, so keys repeat within
+  // and across partitions
+  for (int i=0; i< NUMFILES; i++) {
+    filenames[i] = calloc(FILENAMESIZE,1);
+    if (i < 16) {
+      sprintf(filenames[i], "./test_files/largevals%d.txt", i);
+    } else if (i < 32) {
+      sprintf(filenames[i], "./test_files/largevals%d.txt", 512 + i - 16);
+    } else {
+      sprintf(filenames[i], "./test_files/largevals%d.txt", i - 32);
+    }
+  }
+
+  MS_Run();
+  MS_SetMemoryBudget(BUDGET);
+
+  RDD* rows = withSerde(map(map(RDDFromFiles(filenames, NUMFILES), GetLines), SplitCols),
+                        RowSerialize, RowDeserialize, NULL);
+  printf("rows %d\n", count(rows));
+  printf("distinct keys %d\n", count(distinct(rows, &key, 16)));
+
+  MS_TearDown();
+  for (int i=0; i< NUMFILES; i++) {
+    free(filenames[i]);
+  }
+
+  int num_threads = getNumThreads();
+  if (num_threads > 1) {
+    printf("Worker threads didn't terminate\n");
+    return 0;
+  }
+  return 0;
+}
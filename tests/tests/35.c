@@ -0,0 +1,60 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include "lib.h"
+#include "minispark.h"
+
+#define NUMFILES 32
+#define NUMPARTS 8
+#define FILENAMESIZE 100
+#define BUDGET (64 * 1024)
+
+int main() {
+
+  char *filenames[NUMFILES];
+  RDD* parts[NUMPARTS];
+
+  struct colpart_ctx pctx;
+  pctx.keynum = 0;
+  JoinKey key = {RowKeyHash, RowKeyEquals, &pctx};
+
+  // the two halves come from independently shuffled key sets, so some keys repeat
+  for (int i=0; i< NUMFILES; i++) {
+    filenames[i] = calloc(FILENAMESIZE,1);
+    sprintf(filenames[i], "./test_files/largevals%d.txt", i < NUMFILES/2 ? i : 512 + i - NUMFILES/2);
+  }
+
+  MS_Run();
+  MS_SetMemoryBudget(BUDGET);
+
+  int per_part = NUMFILES / NUMPARTS;
+  for (int i=0; i< NUMPARTS; i++) {
+    parts[i] = withSerde(map(map(RDDFromFiles(filenames + i*per_part, per_part), GetLines), SplitCols),
+                         RowSerialize, RowDeserialize, NULL);
+  }
+
+  // a union of a union is flattened into one union over every part
+  RDD* first = unionRDDs(parts, NUMPARTS/2);
+  RDD* rest[NUMPARTS/2 + 1];
+  rest[0] = first;
+  for (int i=0; i< NUMPARTS/2; i++) {
+    rest[i+1] = parts[NUMPARTS/2 + i];
+  }
+  RDD* all = unionRDDs(rest, NUMPARTS/2 + 1);
+  printf("dependencies %d partitions %d\n", all->dependencies_cnt, all->partitions_cnt);
+
+  printf("rows %d\n", count(all));
+  printf("distinct keys %d\n", count(distinct(all, &key, 16)));
+
+  MS_TearDown();
+  for (int i=0; i< NUMFILES; i++) {
+    free(filenames[i]);
+  }
+
+  int num_threads = getNumThreads();
+  if (num_threads > 1) {
+    printf("Worker threads didn't terminate\n");
+    return 0;
+  }
+  return 0;
+}
@@ -0,0 +1,60 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lib.h"
+#include "minispark.h"
+
+#define NUMFILES 8
+#define FILENAMESIZE 100
+
+// emits every line of an opened file
+void EmitLines(void* arg, Emitter emit, void* out, void* ctx) {
+  (void)ctx;
+  char* line;
+  while ((line = GetLines(arg)) != NULL) {
+    emit(out, line);
+  }
+}
+
+// emits the words of a line which are at least *ctx characters long
+void SplitWords(void* arg, Emitter emit, void* out, void* ctx) {
+  int minlen = *(int*)ctx;
+  char* saveptr;
+  for (char* word = strtok_r(arg, " \t\n", &saveptr); word != NULL; word = strtok_r(NULL, " \t\n", &saveptr)) {
+    if ((int)strlen(word) >= minlen) {
+      emit(out, strdup(word));
+    }
+  }
+  free(arg);
+}
+
+int main() {
+
+  char *filenames[NUMFILES];
+  for (int i=0; i< NUMFILES; i++) {
+    filenames[i] = calloc(FILENAMESIZE,1);
+    sprintf(filenames[i], "./test_files/largevals%d.txt", i);
+  }
+  int minlen = 5;
+
+  MS_Run();
+
+  RDD* lines = flatMap(RDDFromFiles(filenames, NUMFILES), EmitLines, NULL);
+  RDD* words = flatMap(lines, SplitWords, &minlen);
+  printf("lines %d\n", count(lines));
+  printf("words %d\n", count(words));
+  printf("words with 99 %d\n", count(filter(words, StringContains, "99")));
+
+  MS_TearDown();
+  for (int i=0; i< NUMFILES; i++) {
+    free(filenames[i]);
+  }
+
+  int num_threads = getNumThreads();
+  if (num_threads > 1) {
+    printf("Worker threads didn't terminate\n");
+    return 0;
+  }
+  return 0;
+}
@@ -0,0 +1,72 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lib.h"
+#include "minispark.h"
+
+#define NUMFILES 8
+#define FILENAMESIZE 100
+
+// keeps the rows whose value exceeds the threshold in ctx, which is parsed once per partition
+void AboveThreshold(ListIter* input, Emitter emit, void* out, void* ctx) {
+  long threshold = atol(ctx);
+  void* data;
+  while ((data = iter_next(input)) != NULL) {
+    struct row* row = data;
+    if (atol(row->cols[1]) > threshold) {
+      emit(out, row);
+    } else {
+      free(row);
+    }
+  }
+}
+
+// emits a single row holding the number of rows and the sum of their values
+void Summarize(ListIter* input, Emitter emit, void* out, void* ctx) {
+  (void)ctx;
+  long rows = 0;
+  long sum = 0;
+  void* data;
+  while ((data = iter_next(input)) != NULL) {
+    struct row* row = data;
+    rows++;
+    sum += atol(row->cols[1]);
+    free(row);
+  }
+  struct row* summary = calloc(1, sizeof(struct row));
+  snprintf(summary->cols[0], MAXLEN, "%ld", rows);
+  snprintf(summary->cols[1], MAXLEN, "%ld", sum);
+  summary->ncols = 2;
+  emit(out, summary);
+}
+
+int main() {
+
+  char *filenames[NUMFILES];
+  for (int i=0; i< NUMFILES; i++) {
+    filenames[i] = calloc(FILENAMESIZE,1);
+    sprintf(filenames[i], "./test_files/largevals%d.txt", i);
+  }
+
+  MS_Run();
+
+  RDD* rows = map(map(RDDFromFiles(filenames, NUMFILES), GetLines), SplitCols);
+  RDD* large = mapPartitions(rows, AboveThreshold, "5000");
+  printf("large rows %d\n", count(large));
+
+  // one summary per partition
+  print(mapPartitions(large, Summarize, NULL), RowPrinter);
+
+  MS_TearDown();
+  for (int i=0; i< NUMFILES; i++) {
+    free(filenames[i]);
+  }
+
+  int num_threads = getNumThreads();
+  if (num_threads > 1) {
+    printf("Worker threads didn't terminate\n");
+    return 0;
+  }
+  return 0;
+}
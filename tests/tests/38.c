@@ -0,0 +1,61 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lib.h"
+#include "minispark.h"
+
+#define NUMFILES 32
+#define FILENAMESIZE 100
+#define BUDGET (64 * 1024)
+
+// emits a single line holding the number of lines in the partition
+void CountLines(ListIter* input, Emitter emit, void* out, void* ctx) {
+  (void)ctx;
+  int lines = 0;
+  void* data;
+  while ((data = iter_next(input)) != NULL) {
+    lines++;
+    free(data);
+  }
+  char* summary = NULL;
+  if (asprintf(&summary, "%d", lines) < 0) {
+    exit(1);
+  }
+  emit(out, summary);
+}
+
+void LinePrinter(void* arg) {
+  printf("%s\n", (char*)arg);
+}
+
+int main() {
+
+  char *filenames[NUMFILES];
+  for (int i=0; i< NUMFILES; i++) {
+    filenames[i] = calloc(FILENAMESIZE,1);
+    sprintf(filenames[i], "./test_files/largevals%d.txt", i);
+  }
+
+  MS_Run();
+  MS_SetMemoryBudget(BUDGET);
+
+  RDD* lines = withSerde(map(RDDFromFiles(filenames, NUMFILES), GetLines), StringSerialize, StringDeserialize, NULL);
+
+  // the filter leaves every partition nearly empty, coalesce merges them without a shuffle
+  RDD* matches = coalesce(filter(lines, StringContains, "777"), 4);
+  printf("matches %d in %d partitions\n", count(matches), matches->partitions_cnt);
+  print(mapPartitions(matches, CountLines, NULL), LinePrinter);
+
+  MS_TearDown();
+  for (int i=0; i< NUMFILES; i++) {
+    free(filenames[i]);
+  }
+
+  int num_threads = getNumThreads();
+  if (num_threads > 1) {
+    printf("Worker threads didn't terminate\n");
+    return 0;
+  }
+  return 0;
+}
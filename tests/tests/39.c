@@ -0,0 +1,73 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include "lib.h"
+#include "minispark.h"
+
+#define NUMFILES 16
+#define FILENAMESIZE 100
+
+RDD *rows(char **filenames, int numfiles) {
+  return withSerde(map(map(RDDFromFiles(filenames, numfiles), GetLines), SplitCols),
+                   RowSerialize, RowDeserialize, NULL);
+}
+
+int main() {
+
+  char *filenames[NUMFILES];
+
+  struct colpart_ctx pctx;
+  pctx.keynum = 0;
+  JoinKey key = {RowKeyHash, RowKeyEquals, &pctx};
+
+  struct sumjoin_ctx sctx;
+  sctx.keynum = 0;
+  sctx.target = 1;
+
+  for (int i=0; i< NUMFILES; i++) {
+    filenames[i] = calloc(FILENAMESIZE,1);
+    sprintf(filenames[i], "./test_files/largevals%d.txt", i);
+  }
+
+  MS_Run();
+
+  // a generous target merges the hinted partitions
+  MS_SetAdaptivePartitions(1 << 20);
+  RDD *merged = partitionBy(rows(filenames, NUMFILES), ColumnHashPartitioner, 64, &pctx);
+  int cnt = count(merged);
+  printf("merged rows %d fewer partitions %d\n", cnt, merged->partitions_cnt < 64);
+
+  // a small one splits them
+  MS_SetAdaptivePartitions(64 * 1024);
+  RDD *split = partitionBy(rows(filenames, NUMFILES), ColumnHashPartitioner, 1, &pctx);
+  cnt = count(split);
+  printf("split rows %d more partitions %d\n", cnt, split->partitions_cnt > 1);
+
+  // keys stay together, so distinct still sees every duplicate
+  RDD *both[2] = {rows(filenames, NUMFILES), rows(filenames, NUMFILES / 2)};
+  RDD *keys = distinct(unionRDDs(both, 2), &key, 2);
+  cnt = count(keys);
+  printf("distinct keys %d more partitions %d\n", cnt, keys->partitions_cnt > 2);
+
+  // both sides of a join are planned together, so they still agree on their partitions
+  RDD *left = partitionBy(rows(filenames, NUMFILES / 2), ColumnHashPartitioner, 16, &pctx);
+  RDD *right = partitionBy(rows(filenames, NUMFILES / 4), ColumnHashPartitioner, 16, &pctx);
+  RDD *joined = join(left, right, SumJoin, &sctx);
+  cnt = count(joined);
+  printf("joined rows %d same partitions %d %d more partitions %d\n", cnt,
+         left->partitions_cnt == right->partitions_cnt, joined->partitions_cnt == left->partitions_cnt,
+         left->partitions_cnt > 16);
+
+  MS_SetAdaptivePartitions(0);
+  MS_TearDown();
+  for (int i=0; i< NUMFILES; i++) {
+    free(filenames[i]);
+  }
+
+  int num_threads = getNumThreads();
+  if (num_threads > 1) {
+    printf("Worker threads didn't terminate\n");
+    return 0;
+  }
+  return 0;
+}
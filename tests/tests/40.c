@@ -0,0 +1,85 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lib.h"
+#include "minispark.h"
+
+#define NUMFILES 8
+#define FILENAMESIZE 100
+#define BUDGET (64 * 1024)
+
+// Moves most rows of the left side and a few of the right side to one hot key
+void *HotKey(struct row *row, int hot) {
+  struct row *copy = malloc(sizeof(struct row));
+  memcpy(copy, row, sizeof(struct row));
+  if (hot)
+    strcpy(copy->cols[0], "hot");
+  return copy;
+}
+
+void *HotLeft(void *arg) {
+  struct row *row = arg;
+  return HotKey(row, atoi(row->cols[1]) % 10 < 6);
+}
+
+void *HotRight(void *arg) {
+  struct row *row = arg;
+  return HotKey(row, atoi(row->cols[1]) % 500 == 0);
+}
+
+RDD *side(char **filenames, Mapper hot, void *pctx) {
+  RDD *rows = map(map(RDDFromFiles(filenames, NUMFILES), GetLines), SplitCols);
+  RDD *keyed = withSerde(map(rows, hot), RowSerialize, RowDeserialize, NULL);
+  return partitionBy(keyed, ColumnHashPartitioner, 16, pctx);
+}
+
+int main() {
+
+  char *filenames[NUMFILES];
+
+  struct colpart_ctx pctx;
+  pctx.keynum = 0;
+  JoinKey key = {RowKeyHash, RowKeyEquals, &pctx};
+
+  struct sumjoin_ctx sctx;
+  sctx.keynum = 0;
+  sctx.target = 1;
+
+  for (int i=0; i< NUMFILES; i++) {
+    filenames[i] = calloc(FILENAMESIZE,1);
+    sprintf(filenames[i], "./test_files/largevals%d.txt", i);
+  }
+
+  MS_Run();
+  MS_SetMemoryBudget(BUDGET);
+
+  RDD *plain = hashJoin(side(filenames, HotLeft, &pctx), side(filenames, HotRight, &pctx),
+                        &key, SumJoin, &sctx);
+  printf("rows %d partitions %d\n", count(plain), plain->partitions_cnt);
+
+  // the hot partition is joined in pieces, with the same result
+  MS_SetSkewJoin(2);
+  RDD *hashed = hashJoin(side(filenames, HotLeft, &pctx), side(filenames, HotRight, &pctx),
+                         &key, SumJoin, &sctx);
+  int cnt = count(hashed);
+  printf("hashJoin rows %d split %d\n", cnt, hashed->partitions_cnt > 16);
+
+  RDD *paired = join(side(filenames, HotLeft, &pctx), side(filenames, HotRight, &pctx),
+                     SumJoin, &sctx);
+  cnt = count(paired);
+  printf("join rows %d split %d\n", cnt, paired->partitions_cnt > 16);
+
+  MS_SetSkewJoin(0);
+  MS_TearDown();
+  for (int i=0; i< NUMFILES; i++) {
+    free(filenames[i]);
+  }
+
+  int num_threads = getNumThreads();
+  if (num_threads > 1) {
+    printf("Worker threads didn't terminate\n");
+    return 0;
+  }
+  return 0;
+}
@@ -0,0 +1,86 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lib.h"
+#include "minispark.h"
+
+#define NUMFILES 16
+#define FILENAMESIZE 100
+
+// keeps the rows whose value exceeds the threshold in ctx, their keys stay the same
+void AboveThreshold(ListIter* input, Emitter emit, void* out, void* ctx) {
+  long threshold = atol(ctx);
+  void* data;
+  while ((data = iter_next(input)) != NULL) {
+    struct row* row = data;
+    if (atol(row->cols[1]) > threshold) {
+      emit(out, row);
+    } else {
+      free(row);
+    }
+  }
+}
+
+RDD *rows(char **filenames) {
+  return withSerde(map(map(RDDFromFiles(filenames, NUMFILES), GetLines), SplitCols),
+                   RowSerialize, RowDeserialize, NULL);
+}
+
+int main() {
+
+  char *filenames[NUMFILES];
+
+  struct colpart_ctx pctx;
+  pctx.keynum = 0;
+  struct colpart_ctx valuectx;
+  valuectx.keynum = 1;
+  JoinKey key = {RowKeyHash, RowKeyEquals, &pctx};
+
+  struct sumjoin_ctx sctx;
+  sctx.keynum = 0;
+  sctx.target = 1;
+
+  for (int i=0; i< NUMFILES; i++) {
+    filenames[i] = calloc(FILENAMESIZE,1);
+    sprintf(filenames[i], "./test_files/largevals%d.txt", i);
+  }
+
+  MS_Run();
+  MS_SetDiskShuffle(true);
+
+  RDD *bykey = partitionBy(rows(filenames), ColumnHashPartitioner, 16, &pctx);
+  RDD *above = withSerde(preservesPartitioning(mapPartitions(bykey, AboveThreshold, "500")),
+                         RowSerialize, RowDeserialize, NULL);
+
+  // the same partitioning again is skipped, others are not
+  RDD *again = partitionBy(above, ColumnHashPartitioner, 16, &pctx);
+  printf("same skipped %d\n", again == above);
+  printf("fewer partitions skipped %d\n", partitionBy(above, ColumnHashPartitioner, 8, &pctx) == above);
+  printf("other column skipped %d\n", partitionBy(above, ColumnHashPartitioner, 16, &valuectx) == above);
+  RDD *undeclared = mapPartitions(bykey, AboveThreshold, "500");
+  printf("undeclared skipped %d\n", partitionBy(undeclared, ColumnHashPartitioner, 16, &pctx) == undeclared);
+  int cnt = count(again);
+  printf("rows %d shuffle files %d\n", cnt, MS_ShuffleFileCount());
+
+  // both sides partitioned alike, so the join is narrow
+  RDD *other = partitionBy(rows(filenames), ColumnHashPartitioner, 16, &pctx);
+  RDD *joined = hashJoin(again, other, &key, SumJoin, &sctx);
+  printf("co-partitioned %d\n", co_partitioned(joined));
+  cnt = count(joined);
+  printf("joined %d shuffle files %d\n", cnt, MS_ShuffleFileCount());
+  RDD *unrelated = partitionBy(rows(filenames), ColumnHashPartitioner, 16, &valuectx);
+  printf("unrelated co-partitioned %d\n", co_partitioned(hashJoin(again, unrelated, &key, SumJoin, &sctx)));
+
+  MS_TearDown();
+  for (int i=0; i< NUMFILES; i++) {
+    free(filenames[i]);
+  }
+
+  int num_threads = getNumThreads();
+  if (num_threads > 1) {
+    printf("Worker threads didn't terminate\n");
+    return 0;
+  }
+  return 0;
+}
@@ -0,0 +1,63 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include "lib.h"
+#include "minispark.h"
+
+#define ROUNDS 6
+#define NUMFILES (1<<ROUNDS)
+
+// number of joins on the longest path from rdd to an input
+int depth(RDD *rdd) {
+  if (rdd->trans != JOIN)
+    return 0;
+  int left = depth(rdd->dependencies[0]);
+  int right = depth(rdd->dependencies[1]);
+  return 1 + (left > right ? left : right);
+}
+
+void inputs(RDD **files) {
+  for (int i=0; i< NUMFILES; i++) {
+    char *buffer = calloc(50,1);
+    sprintf(buffer, "./test_files/%d", i);
+    files[i] = map(map(RDDFromFiles(&buffer, 1), GetLines), SplitCols);
+    free(buffer);
+  }
+}
+
+int main() {
+
+  struct colpart_ctx pctx;
+  pctx.keynum = 0;
+  JoinKey key = {RowKeyHash, RowKeyEquals, &pctx};
+
+  struct sumjoin_ctx sctx;
+  sctx.keynum = 0;
+  sctx.target = 1;
+
+  MS_Run();
+
+  RDD* files[NUMFILES];
+  inputs(files);
+  RDD *tree = joinAll(files, NUMFILES, NULL, SumJoin, &sctx);
+  printf("depth %d\n", depth(tree));
+  print(tree, RowPrinter);
+
+  // materialized inputs are joined first
+  inputs(files);
+  for (int i=0; i< NUMFILES; i+=8) {
+    count(files[i]);
+  }
+  tree = joinAll(files, NUMFILES, &key, SumJoin, &sctx);
+  printf("depth %d\n", depth(tree));
+  print(tree, RowPrinter);
+
+  MS_TearDown();
+
+  int num_threads = getNumThreads();
+  if (num_threads > 1) {
+    printf("Worker threads didn't terminate\n");
+    return 0;
+  }
+  return 0;
+}
@@ -0,0 +1,69 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lib.h"
+#include "minispark.h"
+
+#define NUMFILES 8
+#define FILENAMESIZE 100
+#define BUFSIZE 300
+
+// compares StringSearch with memmem on haystacks with many partial matches
+int search_mismatches() {
+  char haystack[BUFSIZE];
+  char needle[40];
+  int mismatches = 0;
+  srand(537);
+  for (int round = 0; round < 20000; round++) {
+    size_t len = rand() % BUFSIZE;
+    size_t nlen = rand() % 40;
+    for (size_t i = 0; i < len; i++)
+      haystack[i] = "ab"[rand() % 2];
+    for (size_t i = 0; i < nlen; i++)
+      needle[i] = "ab"[rand() % 2];
+    if (StringSearch(haystack, len, needle, nlen) != memmem(haystack, len, needle, nlen))
+      mismatches++;
+  }
+  return mismatches;
+}
+
+int main() {
+
+  char *filenames[NUMFILES];
+  char *needles[] = {"7", "77", "123", "2024", "99999", "77\n", "asdf"};
+  int numneedles = sizeof(needles) / sizeof(needles[0]);
+
+  for (int i=0; i< NUMFILES; i++) {
+    filenames[i] = calloc(FILENAMESIZE,1);
+    sprintf(filenames[i], "./test_files/largevals%d.txt", i);
+  }
+
+  printf("search mismatches %d\n", search_mismatches());
+
+  MS_Run();
+
+  // searching whole files finds the same lines as filtering every line
+  for (int i = 0; i < numneedles; i++) {
+    RDD *files = RDDFromFiles(filenames, NUMFILES);
+    int filtered = count(filter(map(files, GetLines), StringContains, needles[i]));
+    int grepped = count(flatMap(files, GrepLines, needles[i]));
+    printf("needle %d lines %d same %d\n", i, grepped, filtered == grepped);
+  }
+
+  // procfs reports no size, such files are read line by line
+  char *procfs[1] = {"/proc/self/status"};
+  printf("procfs lines %d\n", count(flatMap(RDDFromFiles(procfs, 1), GrepLines, "Name:")));
+
+  MS_TearDown();
+  for (int i=0; i< NUMFILES; i++) {
+    free(filenames[i]);
+  }
+
+  int num_threads = getNumThreads();
+  if (num_threads > 1) {
+    printf("Worker threads didn't terminate\n");
+    return 0;
+  }
+  return 0;
+}
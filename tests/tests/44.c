@@ -0,0 +1,132 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lib.h"
+#include "minispark.h"
+
+#define NUMFILES 8
+#define FILENAMESIZE 100
+#define BUFSIZE 200
+#define NUMPATTERNS 6
+#define MANYPATTERNS 600
+
+typedef struct {
+  char **patterns;
+  int cnt;
+} Needles;
+
+// reference for the any mode, one strstr per pattern
+int contains_any(void* arg, void* ctx) {
+  Needles *needles = ctx;
+  for (int i = 0; i < needles->cnt; i++) {
+    if (strstr(arg, needles->patterns[i]) != NULL)
+      return 1;
+  }
+  free(arg);
+  return 0;
+}
+
+// compares the automaton with strstr on random strings with overlapping patterns, some
+// rounds use more patterns than all mode tracks on the stack
+int match_mismatches() {
+  char str[BUFSIZE];
+  char buf[MANYPATTERNS][16];
+  char *patterns[MANYPATTERNS];
+  int mismatches = 0;
+  srand(911);
+  for (int round = 0; round < 2000; round++) {
+    int many = round % 100 == 0;
+    int npatterns = many ? MANYPATTERNS : rand() % (NUMPATTERNS + 1);
+    for (int i = 0; i < npatterns; i++) {
+      int len = many ? 1 + rand() % 15 : rand() % 6;
+      for (int j = 0; j < len; j++)
+        buf[i][j] = "ab"[rand() % 2];
+      buf[i][len] = '\0';
+      patterns[i] = buf[i];
+    }
+    struct pattern_set *any = CompilePatterns(patterns, npatterns, 0);
+    struct pattern_set *all = CompilePatterns(patterns, npatterns, 1);
+    for (int k = 0; k < 10; k++) {
+      int len = rand() % BUFSIZE;
+      for (int j = 0; j < len; j++)
+        str[j] = "ab"[rand() % 2];
+      str[len] = '\0';
+      int found = 0;
+      for (int i = 0; i < npatterns; i++)
+        found += strstr(str, patterns[i]) != NULL;
+      if (StringMatchesPatterns(strdup(str), any) != (found > 0))
+        mismatches++;
+      if (StringMatchesPatterns(strdup(str), all) != (found == npatterns))
+        mismatches++;
+    }
+    FreePatterns(any);
+    FreePatterns(all);
+  }
+  return mismatches;
+}
+
+int main() {
+
+  char *filenames[NUMFILES];
+  char *sets[][4] = {{"7", "77", "777", NULL},
+                     {"12", "23", "123", NULL},
+                     {"99", "1", "99", NULL},
+                     {"5", "8", "0", NULL},
+                     {"asdf", "3", "", NULL}};
+  int numsets = sizeof(sets) / sizeof(sets[0]);
+
+  for (int i=0; i< NUMFILES; i++) {
+    filenames[i] = calloc(FILENAMESIZE,1);
+    sprintf(filenames[i], "./test_files/largevals%d.txt", i);
+  }
+
+  printf("match mismatches %d\n", match_mismatches());
+
+  MS_Run();
+
+  // one automaton shared by all tasks finds the same lines as a filter per pattern
+  for (int i = 0; i < numsets; i++) {
+    Needles needles = {sets[i], 3};
+    struct pattern_set *any = CompilePatterns(sets[i], 3, 0);
+    struct pattern_set *all = CompilePatterns(sets[i], 3, 1);
+
+    RDD *files = RDDFromFiles(filenames, NUMFILES);
+    RDD *lines = map(files, GetLines);
+    int matched_any = count(filter(lines, StringMatchesPatterns, any));
+    int expected_any = count(filter(map(files, GetLines), contains_any, &needles));
+
+    RDD *chained = map(files, GetLines);
+    for (int j = 0; j < 3; j++)
+      chained = filter(chained, StringContains, sets[i][j]);
+    int matched_all = count(filter(map(files, GetLines), StringMatchesPatterns, all));
+    int expected_all = count(chained);
+
+    printf("set %d any %d same %d all %d same %d\n", i, matched_any,
+           matched_any == expected_any, matched_all, matched_all == expected_all);
+    FreePatterns(any);
+    FreePatterns(all);
+  }
+
+  // an empty pattern file, every line contains all of no patterns but none any of them
+  struct pattern_set *none_any = LoadPatterns("/dev/null", 0);
+  struct pattern_set *none_all = LoadPatterns("/dev/null", 1);
+  RDD *files = RDDFromFiles(filenames, NUMFILES);
+  int matched_any = count(filter(map(files, GetLines), StringMatchesPatterns, none_any));
+  int matched_all = count(filter(map(files, GetLines), StringMatchesPatterns, none_all));
+  printf("no patterns any %d all %d\n", matched_any, matched_all);
+  FreePatterns(none_any);
+  FreePatterns(none_all);
+
+  MS_TearDown();
+  for (int i=0; i< NUMFILES; i++) {
+    free(filenames[i]);
+  }
+
+  int num_threads = getNumThreads();
+  if (num_threads > 1) {
+    printf("Worker threads didn't terminate\n");
+    return 0;
+  }
+  return 0;
+}
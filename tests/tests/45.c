@@ -0,0 +1,112 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lib.h"
+#include "minispark.h"
+
+#define NUMFILES 4
+#define FILENAMESIZE 100
+#define BUFSIZE 300
+
+long sums[2];
+
+void* add_sum(void* arg) {
+  struct row* row = arg;
+  __atomic_fetch_add(&sums[0], atol(row->cols[1]), __ATOMIC_RELAXED);
+  return arg;
+}
+
+void* add_sum_fields(void* arg) {
+  struct row* row = arg;
+  __atomic_fetch_add(&sums[1], atol(row->cols[1]), __ATOMIC_RELAXED);
+  return arg;
+}
+
+// compares FindFields, SplitCols and SplitFields with strtok_r on lines with runs of
+// delimiters, long fields and more fields than fit in a row
+int split_mismatches() {
+  char line[BUFSIZE];
+  char copy[BUFSIZE];
+  int mismatches = 0;
+  srand(1024);
+  for (int round = 0; round < 20000; round++) {
+    int len = rand() % BUFSIZE;
+    for (int i = 0; i < len; i++)
+      line[i] = "ab1 \t\n"[rand() % (round % 2 ? 6 : 4)];
+    line[len] = '\0';
+
+    int starts[MAXCOLS], lens[MAXCOLS];
+    int nfields = FindFields(line, len, starts, lens, MAXCOLS);
+    struct row* row = SplitCols(strdup(line));
+    struct field_row* fields = SplitFields(strdup(line));
+
+    strcpy(copy, line);
+    char* saveptr;
+    int nc = 0;
+    for (char* tok = strtok_r(copy, " \t\n", &saveptr); tok != NULL && nc < MAXCOLS;
+         tok = strtok_r(NULL, " \t\n", &saveptr), nc++) {
+      if (nc >= nfields || starts[nc] != tok - copy || lens[nc] != (int)strlen(tok))
+        mismatches++;
+      if (nc >= row->ncols || strncmp(row->cols[nc], tok, MAXLEN - 1) != 0 ||
+          strlen(row->cols[nc]) > MAXLEN - 1)
+        mismatches++;
+      if (nc >= fields->ncols || strcmp(FIELD(fields, nc), tok) != 0)
+        mismatches++;
+    }
+    if (nc != nfields || nc != row->ncols || nc != fields->ncols)
+      mismatches++;
+    for (int i = fields->ncols; i < MAXCOLS; i++) {
+      if (*FIELD(fields, i) != '\0')
+        mismatches++;
+    }
+    free(row);
+    free(fields);
+  }
+  return mismatches;
+}
+
+int main() {
+
+  char *filenames[NUMFILES];
+  for (int i=0; i< NUMFILES; i++) {
+    filenames[i] = calloc(FILENAMESIZE,1);
+    sprintf(filenames[i], "./test_files/largevals%d.txt", i);
+  }
+
+  printf("split mismatches %d\n", split_mismatches());
+
+  MS_Run();
+
+  // the same sum join over copied rows and over rows referencing their line,
+  // the overlapping file joins with itself
+  struct sumjoin_ctx sctx = {0, 1};
+  struct colpart_ctx pctx = {0};
+  RDD *rows1 = map(map(RDDFromFiles(filenames, 2), GetLines), SplitCols);
+  RDD *rows2 = map(map(RDDFromFiles(filenames + 1, 2), GetLines), SplitCols);
+  RDD *joined = join(partitionBy(rows1, ColumnHashPartitioner, 4, &pctx),
+                     partitionBy(rows2, ColumnHashPartitioner, 4, &pctx), SumJoin, &sctx);
+  int rows = count(map(joined, add_sum));
+
+  RDD *fields1 = map(map(RDDFromFiles(filenames, 2), GetLines), SplitFields);
+  RDD *fields2 = map(map(RDDFromFiles(filenames + 1, 2), GetLines), SplitFields);
+  RDD *fjoined = join(partitionBy(fields1, FieldColumnHashPartitioner, 4, &pctx),
+                      partitionBy(fields2, FieldColumnHashPartitioner, 4, &pctx),
+                      FieldSumJoin, &sctx);
+  int frows = count(map(fjoined, add_sum_fields));
+
+  printf("rows %d sum %ld\n", rows, sums[0]);
+  printf("field rows %d sum %ld\n", frows, sums[1]);
+
+  MS_TearDown();
+  for (int i=0; i< NUMFILES; i++) {
+    free(filenames[i]);
+  }
+
+  int num_threads = getNumThreads();
+  if (num_threads > 1) {
+    printf("Worker threads didn't terminate\n");
+    return 0;
+  }
+  return 0;
+}
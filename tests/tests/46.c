@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "lib.h"
+#include "minispark.h"
+
+#define NUMFILES 32
+#define FILENAMESIZE 100
+#define MAXTASKS 4096
+
+char *filenames[NUMFILES];
+RDD *shared;
+int counted[2];
+int printed;
+
+typedef struct {
+  SchedPool *pool;
+  RDD *rdd;
+  int result;
+} Action;
+
+// a slow mapper over the lines of a file, so that jobs overlap
+void* SlowLines(void* arg) {
+  usleep(2000);
+  return GetLines(arg);
+}
+
+void CountPrinter(void* arg) {
+  (void)arg;
+  __atomic_fetch_add(&printed, 1, __ATOMIC_RELAXED);
+}
+
+void *count_shared(void *arg) {
+  counted[(long)arg] = count(shared);
+  return NULL;
+}
+
+void *print_shared(void *arg) {
+  (void)arg;
+  usleep(5000);
+  print(shared, CountPrinter);
+  return NULL;
+}
+
+void *run_action(void *arg) {
+  Action *action = arg;
+  MS_SetPool(action->pool);
+  action->result = count(action->rdd);
+  return NULL;
+}
+
+RDD *slow_rdd(int numfiles) {
+  return map(RDDFromFiles(filenames, numfiles), SlowLines);
+}
+
+// runs both actions, the second one once the first one is under way
+void run_both(Action *first, Action *second, int delay) {
+  pthread_t threads[2];
+  pthread_create(&threads[0], NULL, run_action, first);
+  usleep(delay);
+  pthread_create(&threads[1], NULL, run_action, second);
+  pthread_join(threads[0], NULL);
+  pthread_join(threads[1], NULL);
+}
+
+typedef struct {
+  void *rdd;
+  long created;
+  long scheduled;
+} Started;
+
+Started tasks[MAXTASKS];
+int tasks_cnt;
+
+void read_metrics() {
+  FILE *fp = fopen("metrics.log", "r");
+  char line[512];
+  while (fgets(line, sizeof(line), fp) != NULL && tasks_cnt < MAXTASKS) {
+    Started *t = &tasks[tasks_cnt];
+    long cs, cu, ss, su;
+    int pnum, trans;
+    if (sscanf(line, "RDD %p Part %d Trans %d -- creation %ld.%ld, scheduled %ld.%ld",
+               &t->rdd, &pnum, &trans, &cs, &cu, &ss, &su) != 7)
+      continue;
+    t->created = cs * 1000000 + cu;
+    t->scheduled = ss * 1000000 + su;
+    tasks_cnt++;
+  }
+  fclose(fp);
+}
+
+// counts the tasks of a and b started while both jobs had tasks left to start
+void overlap(RDD *a, RDD *b, int *started_a, int *started_b) {
+  long first_a = -1, first_b = -1, last_a = 0, last_b = 0;
+  for (int i = 0; i < tasks_cnt; i++) {
+    if (tasks[i].rdd == a) {
+      if (first_a < 0 || tasks[i].created < first_a)
+        first_a = tasks[i].created;
+      if (tasks[i].scheduled > last_a)
+        last_a = tasks[i].scheduled;
+    } else if (tasks[i].rdd == b) {
+      if (first_b < 0 || tasks[i].created < first_b)
+        first_b = tasks[i].created;
+      if (tasks[i].scheduled > last_b)
+        last_b = tasks[i].scheduled;
+    }
+  }
+  long start = first_a > first_b ? first_a : first_b;
+  long end = last_a < last_b ? last_a : last_b;
+  *started_a = *started_b = 0;
+  for (int i = 0; i < tasks_cnt; i++) {
+    if (tasks[i].scheduled <= start || tasks[i].scheduled >= end)
+      continue;
+    *started_a += tasks[i].rdd == a;
+    *started_b += tasks[i].rdd == b;
+  }
+}
+
+int main() {
+  for (int i = 0; i < NUMFILES; i++) {
+    filenames[i] = calloc(FILENAMESIZE, 1);
+    sprintf(filenames[i], "./test_files/%d", i);
+  }
+
+  MS_Run();
+
+  // two counts and a print of one RDD, the later actions find its partitions in progress
+  pthread_t threads[3];
+  shared = slow_rdd(NUMFILES);
+  pthread_create(&threads[0], NULL, count_shared, (void *)0);
+  pthread_create(&threads[1], NULL, print_shared, NULL);
+  usleep(5000);
+  pthread_create(&threads[2], NULL, count_shared, (void *)1);
+  for (int i = 0; i < 3; i++)
+    pthread_join(threads[i], NULL);
+  printf("shared counts %d %d printed %d\n", counted[0], counted[1], printed);
+
+  // a job of a pool with higher priority goes ahead of the queued tasks of an earlier job
+  SchedPool *low = MS_CreatePool("low", POOL_FIFO, 1, 0);
+  SchedPool *high = MS_CreatePool("high", POOL_FIFO, 1, 1);
+  Action slow = {low, slow_rdd(NUMFILES), 0};
+  Action urgent = {high, slow_rdd(NUMFILES / 4), 0};
+  run_both(&slow, &urgent, 10000);
+
+  // pools with the same priority share the workers by weight
+  MS_SetSchedulingMode(POOL_FAIR);
+  SchedPool *light = MS_CreatePool("light", POOL_FAIR, 1, 0);
+  SchedPool *heavy = MS_CreatePool("heavy", POOL_FAIR, 3, 0);
+  Action lightjob = {light, slow_rdd(NUMFILES), 0};
+  Action heavyjob = {heavy, slow_rdd(NUMFILES), 0};
+  run_both(&lightjob, &heavyjob, 0);
+
+  MS_TearDown();
+  read_metrics();
+
+  int started_low, started_high, started_light, started_heavy;
+  overlap(slow.rdd, urgent.rdd, &started_low, &started_high);
+  overlap(lightjob.rdd, heavyjob.rdd, &started_light, &started_heavy);
+  printf("priority counts %d %d, low tasks started meanwhile %d\n", slow.result, urgent.result, started_low);
+  printf("weight counts %d %d, heavy pool started at least as many %d\n", lightjob.result,
+         heavyjob.result, started_heavy >= started_light);
+
+  for (int i = 0; i < NUMFILES; i++) {
+    free(filenames[i]);
+  }
+
+  int num_threads = getNumThreads();
+  if (num_threads > 1) {
+    printf("Worker threads didn't terminate\n");
+    return 0;
+  }
+  return 0;
+}
@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "lib.h"
+#include "minispark.h"
+
+#define NUMFILES 16
+#define FILENAMESIZE 100
+#define CHAIN 4
+#define MAXTASKS 4096
+
+typedef struct {
+  void *rdd;
+  long scheduled;
+} Started;
+
+Started tasks[MAXTASKS];
+int tasks_cnt;
+
+void* SlowLines(void* arg) {
+  usleep(1000);
+  return GetLines(arg);
+}
+
+void* SlowRow(void* arg) {
+  usleep(1000);
+  return arg;
+}
+
+void read_metrics() {
+  FILE *fp = fopen("metrics.log", "r");
+  char line[512];
+  while (fgets(line, sizeof(line), fp) != NULL && tasks_cnt < MAXTASKS) {
+    Started *t = &tasks[tasks_cnt];
+    long cs, cu, ss, su;
+    int pnum, trans;
+    if (sscanf(line, "RDD %p Part %d Trans %d -- creation %ld.%ld, scheduled %ld.%ld",
+               &t->rdd, &pnum, &trans, &cs, &cu, &ss, &su) != 7)
+      continue;
+    t->scheduled = ss * 1000000 + su;
+    tasks_cnt++;
+  }
+  fclose(fp);
+}
+
+// first or last time a task of rdd was scheduled
+long scheduled(RDD *rdd, int last) {
+  long result = -1;
+  for (int i = 0; i < tasks_cnt; i++) {
+    if (tasks[i].rdd != rdd)
+      continue;
+    if (result < 0 || (last ? tasks[i].scheduled > result : tasks[i].scheduled < result))
+      result = tasks[i].scheduled;
+  }
+  return result;
+}
+
+int main() {
+  char *filenames[NUMFILES];
+  for (int i = 0; i < NUMFILES; i++) {
+    filenames[i] = calloc(FILENAMESIZE, 1);
+    sprintf(filenames[i], "./test_files/%d", i);
+  }
+
+  MS_Run();
+
+  // The short side is submitted first, but the head of the long chain has the longest
+  // path to the result, so all of its tasks are picked before those of the short side
+  struct sumjoin_ctx sctx = {0, 1};
+  RDD *shortside = map(map(RDDFromFiles(filenames, NUMFILES), SlowLines), SplitCols);
+  RDD *head = map(RDDFromFiles(filenames, NUMFILES), SlowLines);
+  RDD *longside = map(head, SplitCols);
+  for (int i = 0; i < CHAIN; i++)
+    longside = map(longside, SlowRow);
+  int rows = count(join(shortside, longside, SumJoin, &sctx));
+
+  MS_TearDown();
+  read_metrics();
+
+  printf("rows %d\n", rows);
+  printf("long chain first %d\n", scheduled(head, 1) < scheduled(shortside->dependencies[0], 0));
+
+  for (int i = 0; i < NUMFILES; i++) {
+    free(filenames[i]);
+  }
+
+  int num_threads = getNumThreads();
+  if (num_threads > 1) {
+    printf("Worker threads didn't terminate\n");
+    return 0;
+  }
+  return 0;
+}
@@ -0,0 +1,50 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "lib.h"
+#include "minispark.h"
+
+#define NUMFILES 16
+
+// SplitCols frees the line it splits, so a speculative copy must not see the same lines
+// as the straggler it duplicates
+void* SlowSplitCols(void* arg) {
+  usleep(200);
+  return SplitCols(arg);
+}
+
+int main() {
+
+  // every partition holds a few lines except the last one, which straggles with 1024
+  char *filenames[NUMFILES];
+  for (int i=0; i< NUMFILES; i++) {
+    filenames[i] = calloc(100,1);
+    if (i < NUMFILES - 1)
+      sprintf(filenames[i], "./test_files/%d", i);
+    else
+      sprintf(filenames[i], "./test_files/largevals0.txt");
+  }
+
+  // two workers without serializers, so the copy runs next to the straggler on one cpu too
+  MS_RunCluster(2);
+  MS_SetSpeculation(1.5);
+
+  RDD* lines = map(RDDFromFiles(filenames, NUMFILES), GetLines);
+  count(lines);
+  RDD* rows = map(lines, SlowSplitCols);
+  printf("rows %d\n", count(rows));
+  printf("speculated %d\n", MS_SpeculatedCount() > 0);
+
+  MS_TearDown();
+  for (int i=0; i< NUMFILES; i++) {
+    free(filenames[i]);
+  }
+
+  int num_threads = getNumThreads();
+  if (num_threads > 1) {
+    printf("Worker threads didn't terminate\n");
+    return 0;
+  }
+  return 0;
+}
@@ -0,0 +1,73 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "lib.h"
+#include "minispark.h"
+
+#define NUMFILES 16
+#define FILENAMESIZE 100
+#define BUDGET (64 * 1024)
+#define K 5
+
+int ValueCompare(void* arg1, void* arg2) {
+  struct row* row1 = arg1;
+  struct row* row2 = arg2;
+  long a = atol(row1->cols[1]);
+  long b = atol(row2->cols[1]);
+  if (a != b) {
+    return a < b ? -1 : 1;
+  }
+  a = atol(row1->cols[0]);
+  b = atol(row2->cols[0]);
+  return a < b ? -1 : a > b;
+}
+
+int printed = 0;
+
+void CountPrinter(void* arg) {
+  (void)arg;
+  printed++;
+}
+
+int main() {
+
+  char *filenames[NUMFILES];
+  for (int i=0; i< NUMFILES; i++) {
+    filenames[i] = calloc(FILENAMESIZE,1);
+    sprintf(filenames[i], "./test_files/largevals%d.txt", i);
+  }
+
+  MS_Run();
+  MS_SetMemoryBudget(BUDGET);
+
+  RDD* rows = withSerde(map(map(RDDFromFiles(filenames, NUMFILES), GetLines), SplitCols),
+                        RowSerialize, RowDeserialize, NULL);
+
+  // the rows are selected while they are computed, so they never exceed the budget
+  topK(rows, K, ValueCompare, RowPrinter);
+  topK(rows, 0, ValueCompare, RowPrinter);
+  printf("spilled during topK %d\n", MS_SpillCount());
+
+  // materialized rows are selected in place
+  printf("rows %d\n", count(rows));
+  topK(rows, K, ValueCompare, RowPrinter);
+  printf("spilled afterwards %d\n", MS_SpillCount() > 0);
+
+  // everything, sorted, with only as much memory as there are rows
+  topK(rows, INT_MAX, ValueCompare, CountPrinter);
+  printf("topK of INT_MAX printed %d\n", printed);
+
+  MS_TearDown();
+  for (int i=0; i< NUMFILES; i++) {
+    free(filenames[i]);
+  }
+
+  int num_threads = getNumThreads();
+  if (num_threads > 1) {
+    printf("Worker threads didn't terminate\n");
+    return 0;
+  }
+  return 0;
+}
@@ -0,0 +1,69 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lib.h"
+#include "minispark.h"
+
+#define NUMFILES 16
+#define FILENAMESIZE 100
+#define NUMPARTITIONS 16
+
+int extracted = 0;
+
+void* ValueKey(void* arg) {
+  __atomic_fetch_add(&extracted, 1, __ATOMIC_RELAXED);
+  long *key = malloc(sizeof(long));
+  *key = atol(((struct row*)arg)->cols[1]);
+  return key;
+}
+
+int ValueCompare(void* key1, void* key2) {
+  long a = *(long*)key1;
+  long b = *(long*)key2;
+  return a < b ? -1 : a > b;
+}
+
+long last = -1;
+int unordered = 0;
+
+void CheckOrder(void* arg) {
+  long value = atol(((struct row*)arg)->cols[1]);
+  if (value < last) {
+    unordered++;
+  }
+  last = value;
+}
+
+int main() {
+
+  char *filenames[NUMFILES];
+  for (int i=0; i< NUMFILES; i++) {
+    filenames[i] = calloc(FILENAMESIZE,1);
+    sprintf(filenames[i], "./test_files/largevals%d.txt", i);
+  }
+
+  MS_Run();
+
+  RDD* rows = map(map(RDDFromFiles(filenames, NUMFILES), GetLines), SplitCols);
+  RDD* sorted = sortBy(rows, ValueKey, ValueCompare, NUMPARTITIONS);
+  int cnt = count(sorted);
+  print(sorted, CheckOrder);
+  printf("sorted rows %d, out of order %d\n", cnt, unordered);
+
+  // the range of every row is found once, and its key extracted once more to sort it
+  int samples = NUMFILES * SORT_SAMPLES;
+  printf("keys per row at most 2: %d\n", extracted <= 2 * cnt + samples);
+
+  MS_TearDown();
+  for (int i=0; i< NUMFILES; i++) {
+    free(filenames[i]);
+  }
+
+  int num_threads = getNumThreads();
+  if (num_threads > 1) {
+    printf("Worker threads didn't terminate\n");
+    return 0;
+  }
+  return 0;
+}
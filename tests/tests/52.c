@@ -0,0 +1,81 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lib.h"
+#include "minispark.h"
+
+#define NUMFILES 8
+#define FILENAMESIZE 100
+
+// An element which owns a second allocation, so that free alone would leak the line
+struct box {
+  char *line;
+};
+
+int freed = 0;
+
+void* Box(void* arg) {
+  struct box *box = malloc(sizeof(struct box));
+  box->line = arg;
+  return box;
+}
+
+size_t BoxSerialize(void* arg, FILE* fp) {
+  return StringSerialize(((struct box *)arg)->line, fp);
+}
+
+void* BoxDeserialize(FILE* fp) {
+  char *line = StringDeserialize(fp);
+  return line != NULL ? Box(line) : NULL;
+}
+
+void BoxFree(void* arg) {
+  struct box *box = arg;
+  free(box->line);
+  free(box);
+  __atomic_fetch_add(&freed, 1, __ATOMIC_RELAXED);
+}
+
+unsigned long BoxPartitioner(void* arg, int numpartitions, void* ctx) {
+  (void)ctx;
+  unsigned long hash = 5381;
+  for (char *c = ((struct box *)arg)->line; *c != '\0'; c++)
+    hash = hash * 33 + (unsigned char)*c;
+  return hash % numpartitions;
+}
+
+int main() {
+
+  char *filenames[NUMFILES];
+  for (int i=0; i< NUMFILES; i++) {
+    filenames[i] = calloc(FILENAMESIZE,1);
+    sprintf(filenames[i], "./test_files/largevals%d.txt", i);
+  }
+
+  MS_Run();
+  MS_SetDiskShuffle(true);
+
+  RDD* boxes = withSerde(map(map(RDDFromFiles(filenames, NUMFILES), GetLines), Box),
+                         BoxSerialize, BoxDeserialize, BoxFree);
+  RDD* shuffled = partitionBy(boxes, BoxPartitioner, 16, NULL);
+
+  // the shuffle files hold copies, so every parent item is freed once it was written
+  int first = count(shuffled);
+  int second = count(shuffled);
+  printf("boxes %d %d\n", first, second);
+  printf("shuffle files %d\n", MS_ShuffleFileCount());
+  printf("parent items freed %d\n", __atomic_load_n(&freed, __ATOMIC_RELAXED));
+
+  MS_TearDown();
+  for (int i=0; i< NUMFILES; i++) {
+    free(filenames[i]);
+  }
+
+  int num_threads = getNumThreads();
+  if (num_threads > 1) {
+    printf("Worker threads didn't terminate\n");
+    return 0;
+  }
+  return 0;
+}
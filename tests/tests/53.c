@@ -0,0 +1,37 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include "lib.h"
+#include "minispark.h"
+
+int main() {
+
+  // short and blank lines, a missing key or target column reads as ""
+  char *left[1] = {"./test_files/shortvals1.txt"};
+  char *right[1] = {"./test_files/shortvals2.txt"};
+
+  struct sumjoin_ctx sctx = {0, 1};
+  struct colpart_ctx pctx = {0};
+  JoinKey key = {FieldRowKeyHash, FieldRowKeyEquals, &pctx};
+
+  MS_Run();
+
+  RDD *data1 = map(map(RDDFromFiles(left, 1), GetLines), SplitFields);
+  RDD *data2 = map(map(RDDFromFiles(right, 1), GetLines), SplitFields);
+  print(join(data1, data2, FieldSumJoin, &sctx), RowPrinter);
+
+  RDD *part1 = partitionBy(map(map(RDDFromFiles(left, 1), GetLines), SplitFields),
+                           FieldColumnHashPartitioner, 4, &pctx);
+  RDD *part2 = partitionBy(map(map(RDDFromFiles(right, 1), GetLines), SplitFields),
+                           FieldColumnHashPartitioner, 4, &pctx);
+  print(hashJoin(part1, part2, &key, FieldSumJoin, &sctx), RowPrinter);
+
+  MS_TearDown();
+
+  int num_threads = getNumThreads();
+  if (num_threads > 1) {
+    printf("Worker threads didn't terminate\n");
+    return 0;
+  }
+  return 0;
+}